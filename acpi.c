@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <acpi.h>
+#include <mmu.h>
+#include <numa.h>
+#include <processor.h>
+#include <string.h>
+
+acpi_ioapic_t acpi_ioapics[ACPI_MAX_IOAPICS];
+uint32_t      acpi_ioapic_count;
+acpi_iso_t    acpi_isos[ACPI_MAX_ISOS];
+uint32_t      acpi_iso_count;
+
+static const acpi_rsdp_t       *acpi_rsdp;
+static const acpi_sdt_header_t *acpi_root; /* XSDT or RSDT */
+static bool                     acpi_root_is_xsdt;
+
+/* ACPI tables live in firmware memory, reach them through the linear map */
+#define ACPI_PTR(pa) ((const void *)X86_P2KV(pa))
+
+static bool acpi_checksum_ok(const void *table, size_t len)
+{
+    const uint8_t *p = table;
+    uint8_t        sum = 0;
+
+    while (len--) {
+        sum += *p++;
+    }
+
+    return sum == 0;
+}
+
+/*
+ * Iterates over the variable sized entries following the fixed part of the
+ * MADT and SRAT.
+ */
+#define acpi_for_each_subtable(sub, table, start)                              \
+    for ((sub) = (const acpi_subtable_header_t *)(start);                      \
+         (uintptr_t)(sub) + sizeof(*(sub)) <=                                  \
+             (uintptr_t)(table) + (table)->header.length &&                    \
+         (sub)->length;                                                        \
+         (sub) = (const acpi_subtable_header_t *)((uintptr_t)(sub) +           \
+                                                  (sub)->length))
+
+void acpi_set_rsdp(const void *rsdp)
+{
+    acpi_rsdp = rsdp;
+}
+
+bool acpi_init(void)
+{
+    if (!acpi_rsdp || memcmp(acpi_rsdp->signature, "RSD PTR ", 8)) {
+        return false;
+    }
+
+    /* the first 20 bytes are the ACPI 1.0 structure */
+    if (!acpi_checksum_ok(acpi_rsdp, 20)) {
+        return false;
+    }
+
+    if (acpi_rsdp->revision >= 2 && acpi_rsdp->xsdt_addr &&
+        acpi_checksum_ok(acpi_rsdp, acpi_rsdp->length)) {
+        acpi_root = ACPI_PTR(acpi_rsdp->xsdt_addr);
+        acpi_root_is_xsdt = true;
+    }
+    else {
+        acpi_root = ACPI_PTR(acpi_rsdp->rsdt_addr);
+        acpi_root_is_xsdt = false;
+    }
+
+    if (!acpi_checksum_ok(acpi_root, acpi_root->length)) {
+        acpi_root = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+const acpi_sdt_header_t *acpi_find_table(const char *sig)
+{
+    if (!acpi_root) {
+        return NULL;
+    }
+
+    size_t entry_size = acpi_root_is_xsdt ? sizeof(uint64_t) : sizeof(uint32_t);
+    size_t count = (acpi_root->length - sizeof(*acpi_root)) / entry_size;
+    const uint8_t *entries = (const uint8_t *)(acpi_root + 1);
+
+    for (size_t i = 0; i < count; ++i) {
+        paddr_t pa;
+
+        /* the entries are not naturally aligned */
+        if (acpi_root_is_xsdt) {
+            uint64_t addr;
+            memcpy(&addr, entries + i * entry_size, sizeof(addr));
+            pa = addr;
+        }
+        else {
+            uint32_t addr;
+            memcpy(&addr, entries + i * entry_size, sizeof(addr));
+            pa = addr;
+        }
+
+        const acpi_sdt_header_t *table = ACPI_PTR(pa);
+        if (!memcmp(table->signature, sig, 4) &&
+            acpi_checksum_ok(table, table->length)) {
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+static void acpi_register_cpu(uint32_t apic_id)
+{
+    /* the boot processor is already registered, and firmware may list a
+     * processor both as LAPIC and x2APIC */
+    for (uint32_t num = 0; num < processor_count; ++num) {
+        if (processor_array[num].apic_id == apic_id) {
+            return;
+        }
+    }
+
+    processor_register(apic_id);
+}
+
+bool acpi_madt_init(void)
+{
+    const acpi_madt_t *madt =
+        (const acpi_madt_t *)acpi_find_table(ACPI_SIG_MADT);
+    if (!madt) {
+        return false;
+    }
+
+    const acpi_subtable_header_t *sub;
+    acpi_for_each_subtable (sub, madt, madt->entries) {
+        switch (sub->type) {
+        case ACPI_MADT_TYPE_LAPIC:;
+            const acpi_madt_lapic_t *lapic = (const acpi_madt_lapic_t *)sub;
+            if (lapic->flags & ACPI_MADT_CPU_ENABLED) {
+                acpi_register_cpu(lapic->apic_id);
+            }
+            break;
+
+        case ACPI_MADT_TYPE_X2APIC:;
+            const acpi_madt_x2apic_t *x2apic = (const acpi_madt_x2apic_t *)sub;
+            if (x2apic->flags & ACPI_MADT_CPU_ENABLED) {
+                acpi_register_cpu(x2apic->x2apic_id);
+            }
+            break;
+
+        case ACPI_MADT_TYPE_IOAPIC:;
+            const acpi_madt_ioapic_t *ioapic = (const acpi_madt_ioapic_t *)sub;
+            if (acpi_ioapic_count < ACPI_MAX_IOAPICS) {
+                acpi_ioapics[acpi_ioapic_count++] = (acpi_ioapic_t){
+                    .id = ioapic->id,
+                    .addr = ioapic->addr,
+                    .gsi_base = ioapic->gsi_base,
+                };
+            }
+            break;
+
+        case ACPI_MADT_TYPE_ISO:;
+            const acpi_madt_iso_t *iso = (const acpi_madt_iso_t *)sub;
+            if (acpi_iso_count < ACPI_MAX_ISOS) {
+                acpi_isos[acpi_iso_count++] = (acpi_iso_t){
+                    .source = iso->source,
+                    .gsi = iso->gsi,
+                    .flags = iso->flags,
+                };
+            }
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void acpi_slit_init(void)
+{
+    const acpi_slit_t *slit =
+        (const acpi_slit_t *)acpi_find_table(ACPI_SIG_SLIT);
+    if (!slit) {
+        return;
+    }
+
+    /* localities are proximity domains, which all showed up in the SRAT */
+    uint64_t count = slit->locality_count;
+    for (uint64_t from = 0; from < count; ++from) {
+        for (uint64_t to = 0; to < count; ++to) {
+            numa_set_distance(numa_domain_to_node(from),
+                              numa_domain_to_node(to),
+                              slit->entries[from * count + to]);
+        }
+    }
+}
+
+bool acpi_srat_init(void)
+{
+    const acpi_srat_t *srat =
+        (const acpi_srat_t *)acpi_find_table(ACPI_SIG_SRAT);
+    if (!srat) {
+        return false;
+    }
+
+    const acpi_subtable_header_t *sub;
+    acpi_for_each_subtable (sub, srat, srat->entries) {
+        switch (sub->type) {
+        case ACPI_SRAT_TYPE_CPU_AFFINITY:;
+            const acpi_srat_cpu_affinity_t *cpu =
+                (const acpi_srat_cpu_affinity_t *)sub;
+            if (cpu->flags & ACPI_SRAT_ENABLED) {
+                uint32_t domain = cpu->domain_lo | cpu->domain_hi[0] << 8 |
+                                  cpu->domain_hi[1] << 16 |
+                                  cpu->domain_hi[2] << 24;
+                numa_add_cpu(cpu->apic_id, numa_domain_to_node(domain));
+            }
+            break;
+
+        case ACPI_SRAT_TYPE_X2APIC_AFFINITY:;
+            const acpi_srat_x2apic_affinity_t *x2apic =
+                (const acpi_srat_x2apic_affinity_t *)sub;
+            if (x2apic->flags & ACPI_SRAT_ENABLED) {
+                numa_add_cpu(x2apic->x2apic_id,
+                             numa_domain_to_node(x2apic->domain));
+            }
+            break;
+
+        case ACPI_SRAT_TYPE_MEMORY_AFFINITY:;
+            const acpi_srat_mem_affinity_t *mem =
+                (const acpi_srat_mem_affinity_t *)sub;
+            if ((mem->flags & ACPI_SRAT_ENABLED) && mem->length) {
+                numa_add_memblock(mem->base, mem->length,
+                                  numa_domain_to_node(mem->domain));
+            }
+            break;
+        }
+    }
+
+    acpi_slit_init();
+    return true;
+}
@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <types.h>
+#include <compiler.h>
+
+#define ACPI_SIG_MADT "APIC"
+#define ACPI_SIG_SRAT "SRAT"
+#define ACPI_SIG_SLIT "SLIT"
+
+#define ACPI_MAX_IOAPICS 8
+#define ACPI_MAX_ISOS    16
+
+typedef struct __packed acpi_rsdp {
+    char     signature[8]; /* "RSD PTR " */
+    uint8_t  checksum;     /* Checksum of the first 20 bytes. */
+    char     oem_id[6];
+    uint8_t  revision;     /* 0 for ACPI 1.0, 2 for later revisions. */
+    uint32_t rsdt_addr;
+
+    /* revision 2 and later */
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t  ext_checksum; /* Checksum of the whole table. */
+    uint8_t  reserved[3];
+} acpi_rsdp_t;
+
+typedef struct __packed acpi_sdt_header {
+    char     signature[4];
+    uint32_t length; /* Length of the table including the header. */
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem_id[6];
+    char     oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} acpi_sdt_header_t;
+
+/**
+ * Multiple APIC Description Table.
+ */
+typedef struct __packed acpi_madt {
+    acpi_sdt_header_t header;
+    uint32_t          lapic_addr;
+    uint32_t          flags;
+    uint8_t           entries[];
+} acpi_madt_t;
+
+enum acpi_madt_type {
+    ACPI_MADT_TYPE_LAPIC = 0,
+    ACPI_MADT_TYPE_IOAPIC = 1,
+    ACPI_MADT_TYPE_ISO = 2,
+    ACPI_MADT_TYPE_X2APIC = 9,
+};
+
+#define ACPI_MADT_CPU_ENABLED (1 << 0)
+
+typedef struct __packed acpi_subtable_header {
+    uint8_t type;
+    uint8_t length;
+} acpi_subtable_header_t;
+
+typedef struct __packed acpi_madt_lapic {
+    acpi_subtable_header_t header;
+    uint8_t                processor_id;
+    uint8_t                apic_id;
+    uint32_t               flags;
+} acpi_madt_lapic_t;
+
+typedef struct __packed acpi_madt_ioapic {
+    acpi_subtable_header_t header;
+    uint8_t                id;
+    uint8_t                reserved;
+    uint32_t               addr;     /* Physical address of the registers. */
+    uint32_t               gsi_base; /* First interrupt handled. */
+} acpi_madt_ioapic_t;
+
+typedef struct __packed acpi_madt_iso {
+    acpi_subtable_header_t header;
+    uint8_t                bus;
+    uint8_t                source; /* Legacy ISA IRQ. */
+    uint32_t               gsi;    /* Interrupt it is routed to. */
+    uint16_t               flags;  /* Polarity and trigger mode. */
+} acpi_madt_iso_t;
+
+typedef struct __packed acpi_madt_x2apic {
+    acpi_subtable_header_t header;
+    uint16_t               reserved;
+    uint32_t               x2apic_id;
+    uint32_t               flags;
+    uint32_t               processor_uid;
+} acpi_madt_x2apic_t;
+
+/**
+ * System Resource Affinity Table.
+ */
+typedef struct __packed acpi_srat {
+    acpi_sdt_header_t header;
+    uint32_t          reserved1;
+    uint64_t          reserved2;
+    uint8_t           entries[];
+} acpi_srat_t;
+
+enum acpi_srat_type {
+    ACPI_SRAT_TYPE_CPU_AFFINITY = 0,
+    ACPI_SRAT_TYPE_MEMORY_AFFINITY = 1,
+    ACPI_SRAT_TYPE_X2APIC_AFFINITY = 2,
+};
+
+#define ACPI_SRAT_ENABLED (1 << 0)
+
+typedef struct __packed acpi_srat_cpu_affinity {
+    acpi_subtable_header_t header;
+    uint8_t                domain_lo;
+    uint8_t                apic_id;
+    uint32_t               flags;
+    uint8_t                sapic_eid;
+    uint8_t                domain_hi[3];
+    uint32_t               clock_domain;
+} acpi_srat_cpu_affinity_t;
+
+typedef struct __packed acpi_srat_mem_affinity {
+    acpi_subtable_header_t header;
+    uint32_t               domain;
+    uint16_t               reserved1;
+    uint64_t               base;
+    uint64_t               length;
+    uint32_t               reserved2;
+    uint32_t               flags;
+    uint64_t               reserved3;
+} acpi_srat_mem_affinity_t;
+
+typedef struct __packed acpi_srat_x2apic_affinity {
+    acpi_subtable_header_t header;
+    uint16_t               reserved1;
+    uint32_t               domain;
+    uint32_t               x2apic_id;
+    uint32_t               flags;
+    uint32_t               clock_domain;
+    uint32_t               reserved2;
+} acpi_srat_x2apic_affinity_t;
+
+/**
+ * System Locality Information Table, a matrix of relative distances between
+ * the proximity domains.
+ */
+typedef struct __packed acpi_slit {
+    acpi_sdt_header_t header;
+    uint64_t          locality_count;
+    uint8_t           entries[];
+} acpi_slit_t;
+
+typedef struct acpi_ioapic {
+    uint32_t id;
+    paddr_t  addr;
+    uint32_t gsi_base;
+} acpi_ioapic_t;
+
+typedef struct acpi_iso {
+    uint8_t  source;
+    uint32_t gsi;
+    uint16_t flags;
+} acpi_iso_t;
+
+extern acpi_ioapic_t acpi_ioapics[ACPI_MAX_IOAPICS];
+extern uint32_t      acpi_ioapic_count;
+extern acpi_iso_t    acpi_isos[ACPI_MAX_ISOS];
+extern uint32_t      acpi_iso_count;
+
+/**
+ * Records the RSDP handed over by the bootloader.
+ *
+ * @param rsdp Copy of the RSDP inside the multiboot2 information.
+ */
+void acpi_set_rsdp(const void *rsdp);
+
+/**
+ * Validates the RSDP and locates the root table (XSDT or RSDT).
+ *
+ * @return true if the firmware provides usable ACPI tables.
+ */
+bool acpi_init(void);
+
+/**
+ * Looks up a table by its signature.
+ *
+ * @param sig Four character table signature.
+ *
+ * @return Table header or NULL if there is no valid table.
+ */
+const acpi_sdt_header_t *acpi_find_table(const char *sig);
+
+/**
+ * Registers every enabled processor listed in the MADT and records the
+ * IOAPICs and the interrupt source overrides.
+ *
+ * @return false if there is no MADT.
+ */
+bool acpi_madt_init(void);
+
+/**
+ * Feeds the processor and memory affinities of the SRAT and the node
+ * distances of the SLIT to the NUMA code.
+ *
+ * @return false if there is no SRAT.
+ */
+bool acpi_srat_init(void);
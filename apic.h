@@ -2,11 +2,101 @@
 
 #pragma once
 
-#define APIC_PHY_BASE 0xfee00000
+#include <stdint.h>
+#include <stdbool.h>
+#include <types.h>
 
+#define APIC_PHY_BASE            0xfee00000
+
+#define LAPIC_TIMER_VECTOR       0xf0
+#define IPI_RESCHEDULE_VECTOR    0xf1
+#define IPI_TLB_SHOOTDOWN_VECTOR 0xf2
+#define IPI_STOP_MACHINE_VECTOR  0xf3
+#define LAPIC_SPURIOUS_VECTOR    0xff
+
+/**
+ * Picks the access mode of the local APICs, x2APIC MSRs when the processor
+ * supports them, MMIO otherwise, and maps the xAPIC registers if needed.
+ * Called once on the boot processor.
+ */
 void apic_create_mapping(void);
 
 /**
  * Initializes the current processor's local APIC.
  */
 void lapic_init(void);
+
+/**
+ * Whether the local APICs are accessed through the x2APIC MSRs.
+ */
+bool lapic_is_x2apic(void);
+
+/**
+ * Local APIC ID of the current processor.
+ */
+uint32_t lapic_get_id(void);
+
+/**
+ * Signals the end of interrupt to the local APIC.
+ */
+void lapic_eoi(void);
+
+/**
+ * Sends a fixed IPI to the specified processor.
+ *
+ * @param apic_id Local APIC ID of the target processor.
+ *
+ * @param vector Interrupt vector raised on the target.
+ */
+void lapic_send_ipi_fixed(uint32_t apic_id, uint8_t vector);
+
+/**
+ * Sends an INIT IPI to the specified processor.
+ *
+ * @param apic_id Local APIC ID of the target processor.
+ */
+void lapic_send_init(uint32_t apic_id);
+
+/**
+ * Sends a STARTUP IPI to the specified processor.
+ *
+ * @param apic_id Local APIC ID of the target processor.
+ *
+ * @param entry Page aligned physical address below 1 MiB where the
+ * processor starts executing in real mode.
+ */
+void lapic_send_startup(uint32_t apic_id, paddr_t entry);
+
+/**
+ * Sends an INIT IPI to every processor but the caller.
+ */
+void lapic_broadcast_init(void);
+
+/**
+ * Sends a STARTUP IPI to every processor but the caller.
+ *
+ * @param entry Page aligned physical address below 1 MiB where the
+ * processors start executing in real mode.
+ */
+void lapic_broadcast_startup(paddr_t entry);
+
+/**
+ * Sets up the local APIC timer of the current processor in TSC-deadline
+ * mode if available, one-shot mode otherwise. The one-shot rate is
+ * measured against the PIT the first time this is called. The timer raises
+ * LAPIC_TIMER_VECTOR and stays masked until armed. Needs clock_init().
+ */
+void lapic_timer_init(void);
+
+/**
+ * Arms the local APIC timer of the current processor to fire once.
+ *
+ * @param ns Time from now in nanoseconds. In one-shot mode a timeout that
+ * does not fit the counter fires early.
+ */
+void lapic_timer_arm(uint64_t ns);
+
+/**
+ * Disarms the local APIC timer of the current processor.
+ */
+void lapic_timer_cancel(void);
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <clock.h>
+#include <pit.h>
+#include <x86.h>
+
+/* time the TSC is measured against the PIT */
+#define CLOCK_CALIBRATE_US 10000
+
+uint64_t clock_tsc_mult;
+
+/* TSC ticks per nanosecond, scaled by 2^CLOCK_SHIFT */
+static uint64_t clock_tsc_mult_inv;
+
+static uint64_t clock_khz;
+static bool     clock_invariant;
+
+/*
+ * TSC rate from the time stamp counter leaf (crystal clock times the
+ * TSC/crystal ratio), or the processor base frequency of leaf 0x16 which
+ * the TSC runs at on the parts that do not report the crystal.
+ */
+static uint64_t clock_cpuid_khz(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+    uint32_t max_leaf = eax;
+
+    if (max_leaf >= 0x15) {
+        x86_cpuid(0x15, &eax, &ebx, &ecx, &edx);
+        if (eax && ebx && ecx) {
+            return (uint64_t)ecx * ebx / eax / 1000;
+        }
+    }
+
+    if (max_leaf >= 0x16) {
+        x86_cpuid(0x16, &eax, &ebx, &ecx, &edx);
+        if (eax & 0xffff) {
+            return (uint64_t)(eax & 0xffff) * 1000;
+        }
+    }
+
+    return 0;
+}
+
+static uint64_t clock_pit_khz(void)
+{
+    uint64_t tsc = x86_rdtsc();
+    pit_udelay(CLOCK_CALIBRATE_US);
+    tsc = x86_rdtsc() - tsc;
+
+    return tsc / (CLOCK_CALIBRATE_US / 1000);
+}
+
+void clock_init(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    x86_cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x80000007) {
+        x86_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        clock_invariant = edx & X86_CPUID_80000007_EDX_INVTSC;
+    }
+
+    clock_khz = clock_cpuid_khz();
+    if (!clock_khz) {
+        clock_khz = clock_pit_khz();
+    }
+
+    /* the only divisions, every conversion afterwards is a multiply-shift */
+    clock_tsc_mult = (NSEC_PER_MSEC << CLOCK_SHIFT) / clock_khz;
+    clock_tsc_mult_inv = (clock_khz << CLOCK_SHIFT) / NSEC_PER_MSEC;
+}
+
+bool clock_tsc_is_invariant(void)
+{
+    return clock_invariant;
+}
+
+uint64_t clock_tsc_khz(void)
+{
+    return clock_khz;
+}
+
+uint64_t clock_ns_to_tsc(uint64_t ns)
+{
+    return ((unsigned __int128)ns * clock_tsc_mult_inv) >> CLOCK_SHIFT;
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <x86.h>
+
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+/* fixed point fraction bits of the TSC conversion factors */
+#define CLOCK_SHIFT   32
+
+/* nanoseconds per TSC tick, scaled by 2^CLOCK_SHIFT */
+extern uint64_t clock_tsc_mult;
+
+/**
+ * Measures the TSC frequency, from CPUID when the processor reports it and
+ * against the PIT otherwise. Called once on the boot processor before any
+ * time is read.
+ */
+void clock_init(void);
+
+/**
+ * Whether the TSC runs at a constant rate in every P-, C- and T-state. The
+ * clock drifts with the processor frequency otherwise.
+ */
+bool clock_tsc_is_invariant(void);
+
+/**
+ * TSC frequency in kHz.
+ */
+uint64_t clock_tsc_khz(void);
+
+/**
+ * Nanoseconds since an arbitrary point at boot. A single TSC read and a
+ * multiply-shift.
+ */
+static inline uint64_t clock_monotonic_ns(void)
+{
+    return ((unsigned __int128)x86_rdtsc() * clock_tsc_mult) >> CLOCK_SHIFT;
+}
+
+/**
+ * Converts a TSC value read earlier to the clock_monotonic_ns() time base.
+ */
+static inline uint64_t clock_tsc_to_ns(uint64_t tsc)
+{
+    return ((unsigned __int128)tsc * clock_tsc_mult) >> CLOCK_SHIFT;
+}
+
+/**
+ * Converts a duration in nanoseconds to TSC ticks.
+ */
+uint64_t clock_ns_to_tsc(uint64_t ns);
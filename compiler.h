@@ -11,7 +11,7 @@
 #define __is_constant(x)      __builtin_constant_p(x)
 #define __offsetof(t, m)      __builtin_offsetof(t, m)
 
-#define unreachable_barrier() asm volatile("")
+#define unreachable_barrier() __asm__ volatile("")
 #define unreachable()                                                          \
     do {                                                                       \
         unreachable_barrier();                                                 \
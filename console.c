@@ -1,25 +1,79 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <clock.h>
+#include <console/console.h>
+#include <spinlock.h>
+#include <timer.h>
+#include <x86.h>
 
-#define FB       (0xb8000 + KERNEL_VMA_BASE)
+#define FB              (0xb8000 + KERNEL_VMA_BASE)
 
-#define TAB_SIZE 4
+#define VGA_COLS        80
+#define VGA_ROWS        25
+#define VGA_ALL_ROWS    ((1U << VGA_ROWS) - 1)
 
-static uint8_t cur_x = 0;
-static uint8_t cur_y = 0;
+#define TAB_SIZE        4
 
-void put_char(uint8_t c, uint8_t fg, uint8_t bg, uint32_t x, uint32_t y)
+/* output is batched for this long before it reaches VGA memory */
+#define VGA_FLUSH_DELAY (20 * NSEC_PER_MSEC)
+
+/*
+ * Characters go to a shadow copy of the screen in RAM and only the lines
+ * that changed are copied to the uncached framebuffer, a line at a time.
+ * The shadow is a ring of lines so scrolling just moves the first line
+ * instead of copying the whole screen.
+ */
+static uint16_t shadow[VGA_ROWS][VGA_COLS];
+static uint32_t shadow_top; /* Shadow line shown at the top of the screen. */
+static uint32_t dirty;      /* Screen lines that differ from VGA memory. */
+
+static uint32_t cur_x = 0;
+static uint32_t cur_y = 0;
+static uint8_t  cur_attrib = 0x0f;
+
+static spin_lock_t vga_lock;
+static timer_t     vga_flush_timer;
+static bool        vga_flush_armed;
+
+static inline uint16_t *vga_line(uint32_t y)
+{
+    return shadow[(shadow_top + y) % VGA_ROWS];
+}
+
+static void vga_clear_line(uint32_t y)
+{
+    uint16_t *line = vga_line(y);
+
+    for (uint32_t x = 0; x < VGA_COLS; ++x) {
+        line[x] = ' ' | (cur_attrib << 8);
+    }
+    dirty |= 1U << y;
+}
+
+static void vga_newline(void)
 {
-    uint8_t            attrib = (bg << 4) | (fg & 0xf);
-    volatile uint16_t *video = (volatile uint16_t *)FB + (cur_y * 80 + cur_x);
+    cur_x = 0;
+    if (++cur_y < VGA_ROWS) {
+        return;
+    }
+
+    /* the old top line becomes the new bottom line, every line on the
+     * screen moves up */
+    shadow_top = (shadow_top + 1) % VGA_ROWS;
+    cur_y = VGA_ROWS - 1;
+    vga_clear_line(cur_y);
+    dirty = VGA_ALL_ROWS;
+}
 
+static void vga_putc(uint8_t c)
+{
     switch (c) {
     case '\t':
-        cur_x += TAB_SIZE;
-        if (cur_x >= 80) {
-            cur_x = 0;
-            cur_y++;
+        cur_x = (cur_x + TAB_SIZE) & ~(TAB_SIZE - 1);
+        if (cur_x >= VGA_COLS) {
+            vga_newline();
         }
         break;
 
@@ -28,33 +82,115 @@ void put_char(uint8_t c, uint8_t fg, uint8_t bg, uint32_t x, uint32_t y)
         break;
 
     case '\n':
-        cur_y++;
+        vga_newline();
         break;
 
     case '\b':
-        cur_x--;
-        *video = ' ';
+        if (cur_x) {
+            cur_x--;
+            vga_line(cur_y)[cur_x] = ' ' | (cur_attrib << 8);
+            dirty |= 1U << cur_y;
+        }
         break;
 
     default:
-        *video = c | (attrib << 8);
-        cur_x++;
-        if (cur_x == 80) {
-            cur_y++;
-            cur_x = 0;
+        vga_line(cur_y)[cur_x] = c | (cur_attrib << 8);
+        dirty |= 1U << cur_y;
+        if (++cur_x == VGA_COLS) {
+            vga_newline();
+        }
+    }
+}
+
+static void vga_flush(void)
+{
+    while (dirty) {
+        uint32_t y = __builtin_ctz(dirty);
+
+        /* quadword stores, a quarter of the uncached writes */
+        volatile uint64_t *dst = (volatile uint64_t *)FB + y * VGA_COLS / 4;
+        const uint64_t    *src = (const uint64_t *)vga_line(y);
+
+        for (uint32_t i = 0; i < VGA_COLS / 4; ++i) {
+            dst[i] = src[i];
         }
+        dirty &= dirty - 1;
     }
 }
 
+static void vga_flush_timer_cb(timer_t *timer, void *arg)
+{
+    uint64_t flags;
+
+    spin_lock_lock_irqsave(&vga_lock, &flags);
+    vga_flush();
+    vga_flush_armed = false;
+    spin_lock_unlock_irqrestore(&vga_lock, flags);
+}
+
+static void vga_console_write(console_t *con, const uint8_t *text, size_t len)
+{
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    /* with interrupts already off this is the panic path, the holder of the
+     * lock may never release it */
+    bool emergency = !(flags & X86_FLAGS_IF);
+    bool locked = spin_lock_trylock(&vga_lock);
+
+    if (!locked && !emergency) {
+        spin_lock_lock(&vga_lock);
+        locked = true;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        vga_putc(text[i]);
+    }
+
+    if (emergency) {
+        vga_flush();
+    }
+    else if (!vga_flush_armed) {
+        vga_flush_armed = true;
+        timer_set_oneshot(&vga_flush_timer, VGA_FLUSH_DELAY,
+                          vga_flush_timer_cb, NULL);
+    }
+
+    if (locked) {
+        spin_lock_unlock(&vga_lock);
+    }
+    x86_restore_flags(flags);
+}
+
+static console_t vga_console = {
+    .name = "vga",
+    .write = vga_console_write,
+};
+
+/* early output, written straight through before the timers run */
 void put_str(char *str, uint8_t forecolor, uint8_t backcolor)
 {
+    cur_attrib = (backcolor << 4) | (forecolor & 0xf);
+
     while (*str != 0) {
-        put_char(*str++, forecolor, backcolor, cur_x, cur_y);
+        vga_putc(*str++);
     }
+    vga_flush();
+
+    cur_attrib = 0x0f;
 }
 
 void platform_init_console(void)
 {
-    put_str("Rix (build 0.0.1)\n\r", 0xf, 0x0);
-    put_str("Welcome to Rix kernel!", 0xf, 0x0);
+    spin_lock_init(&vga_lock);
+    timer_init(&vga_flush_timer);
+
+    for (uint32_t y = 0; y < VGA_ROWS; ++y) {
+        vga_clear_line(y);
+    }
+
+    put_str("Rix (build 0.0.1)\n", 0xf, 0x0);
+    put_str("Welcome to Rix kernel!\n", 0xf, 0x0);
+
+    register_console(&vga_console);
 }
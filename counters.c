@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <counters.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint64_t counter_slot_read(const counter_t *counter, uint32_t cpu,
+                                  uint32_t idx)
+{
+    uint64_t *slots = (uint64_t *)(percpu_offset[cpu] + counter->slots);
+    return slots[idx];
+}
+
+uint64_t counter_read(const counter_t *counter, uint32_t idx)
+{
+    uint64_t sum = 0;
+    uint32_t cpu;
+
+    if (idx >= counter->nslots) {
+        return 0;
+    }
+
+    /* the slots are only written by their own CPU, summing is racy but
+     * never observes a torn value */
+    for_each_possible_cpu (cpu) {
+        sum += counter_slot_read(counter, cpu, idx);
+    }
+
+    return sum;
+}
+
+uint64_t counter_read_total(const counter_t *counter)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t idx = 0; idx < counter->nslots; ++idx) {
+        sum += counter_read(counter, idx);
+    }
+
+    return sum;
+}
+
+const counter_t *counter_find(const char *name)
+{
+    const counter_t *c;
+    counter_for_each (c) {
+        if (!strcmp(c->name, name)) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+void counters_dump(void)
+{
+    const counter_t *c;
+    counter_for_each (c) {
+        printf("%s: %llu (%s)\n", c->name, counter_read_total(c), c->desc);
+
+        if (c->nslots == 1) {
+            continue;
+        }
+
+        /* only print the non zero slots of array counters */
+        for (uint32_t idx = 0; idx < c->nslots; ++idx) {
+            uint64_t val = counter_read(c, idx);
+            if (val) {
+                printf("  [%u]: %llu\n", idx, val);
+            }
+        }
+    }
+}
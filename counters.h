@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <compiler.h>
+#include <percpu.h>
+
+/**
+ * A statistics counter. Every CPU increments its own per-CPU slot without
+ * atomics; the per-CPU values are only summed up when the counter is read.
+ */
+typedef struct counter {
+    const char *name;   /* Counter name. */
+    const char *desc;   /* Short description. */
+    uintptr_t   slots;  /* Per-CPU offset of the counter slots. */
+    uint32_t    nslots; /* Number of slots (1 for scalar counters). */
+} counter_t;
+
+/**
+ * Counter descriptors are collected in the ".counters" section so that the
+ * registry can enumerate all counters declared anywhere in the kernel.
+ */
+#define __counter_desc __section(".counters")
+
+#define COUNTER_NAME(name) counter__##name
+
+/**
+ * Defines a counter with a single slot per CPU.
+ *
+ * @param _name Name of the counter.
+ *
+ * @param _desc Short description of what is counted.
+ */
+#define DEFINE_COUNTER(_name, _desc)                                           \
+    DEFINE_PER_CPU(uint64_t, COUNTER_NAME(_name));                             \
+    static __counter_desc __aligned(8) const counter_t __counter_##_name = {   \
+        .name = stringify(_name),                                              \
+        .desc = _desc,                                                         \
+        .slots = (uintptr_t)&PER_CPU_NAME(COUNTER_NAME(_name)),                \
+        .nslots = 1,                                                           \
+    }
+
+/**
+ * Defines a counter with an array of slots per CPU, e.g. one slot for each
+ * interrupt vector.
+ *
+ * @param _name Name of the counter.
+ *
+ * @param _count Number of slots.
+ *
+ * @param _desc Short description of what is counted.
+ */
+#define DEFINE_COUNTER_ARRAY(_name, _count, _desc)                             \
+    DEFINE_PER_CPU(uint64_t[_count], COUNTER_NAME(_name));                     \
+    static __counter_desc __aligned(8) const counter_t __counter_##_name = {   \
+        .name = stringify(_name),                                              \
+        .desc = _desc,                                                         \
+        .slots = (uintptr_t)&PER_CPU_NAME(COUNTER_NAME(_name)),                \
+        .nslots = _count,                                                      \
+    }
+
+/**
+ * Makes a counter defined in another file usable in this one.
+ */
+#define DECLARE_COUNTER(_name) DECLARE_PER_CPU(uint64_t, COUNTER_NAME(_name))
+#define DECLARE_COUNTER_ARRAY(_name, _count)                                   \
+    DECLARE_PER_CPU(uint64_t[_count], COUNTER_NAME(_name))
+
+#define counter_add(_name, val) this_cpu_add(COUNTER_NAME(_name), val)
+#define counter_inc(_name)      this_cpu_inc(COUNTER_NAME(_name))
+
+#define counter_add_idx(_name, idx, val)                                       \
+    this_cpu_add_idx(COUNTER_NAME(_name), idx, val)
+#define counter_inc_idx(_name, idx) this_cpu_inc_idx(COUNTER_NAME(_name), idx)
+
+/* kernel.lds.S */
+extern const counter_t __counters_start[];
+extern const counter_t __counters_end[];
+
+/**
+ * Iterate over every registered counter.
+ */
+#define counter_for_each(c)                                                    \
+    for ((c) = __counters_start; (c) < __counters_end; (c)++)
+
+/**
+ * Sums up a slot of the counter over all CPUs.
+ *
+ * @param counter Counter to read.
+ *
+ * @param idx Slot index, 0 for scalar counters.
+ *
+ * @return Aggregated value of the slot.
+ */
+uint64_t counter_read(const counter_t *counter, uint32_t idx);
+
+/**
+ * Sums up all the slots of the counter over all CPUs.
+ */
+uint64_t counter_read_total(const counter_t *counter);
+
+/**
+ * Looks up a counter by its name.
+ *
+ * @return Counter or NULL if no such counter is registered.
+ */
+const counter_t *counter_find(const char *name);
+
+/**
+ * Prints every registered counter.
+ */
+void counters_dump(void);
@@ -1,34 +1,62 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <cpu_data.h>
+#include <balloc.h>
+#include <stdlib.h>
+#include <numa.h>
 
-#define MAX_NCPUS 64
+/* boot and idle stack size of the secondary processors */
+#define SECONDARY_STACK_SIZE 16384
+
+/* start.S */
+extern uint8_t _kstack_end[];
 
 cpu_data_t *cpu_data_ptr[MAX_NCPUS];
 
-cpu_data_t  boot_cpu;
-cpu_data_t *secondary_cpus = NULL;
-size_t      num_cpus = 1;
+DEFINE_PER_CPU_FIRST(cpu_data_t, cpu_data);
+
+size_t num_cpus = 1;
 
-cpu_data_t boot_cpu_data = {
-    .cpu_number = 0,
-    .cpu_processor = NULL,
-};
+static void cpu_data_init(uint32_t num)
+{
+    processor_t *processor = &processor_array[num];
+    cpu_data_t  *cpu = per_cpu_ptr(cpu_data, num);
 
-/* bootstrap processor */
-processor_t bsp = {
-    .state = PROCESSOR_STATE_RUNNING, .current_thread = NULL,
-    /* .idle_thread = NULL, */
-};
+    cpu->cpu_number = num;
+    cpu->cpu_processor = processor;
+    cpu->cpu_lapic_id = processor->apic_id;
+    cpu->cpu_node = numa_cpu_to_node(processor->apic_id);
+    cpu->cpu_current_thread = &processor->idle_thread;
+
+    cpu_data_ptr[num] = cpu;
+}
 
 void boot_cpu_init(void)
 {
-    boot_cpu_data.cpu_processor = &bsp;
-    boot_cpu = boot_cpu_data;
+    /* give the boot processor its per-CPU area before anything touches it */
+    percpu_setup_area(0);
+    percpu_load(0);
 
-    cpu_data_ptr[0] = &boot_cpu;
+    processor_bootstrap();
+
+    cpu_data_init(0);
+    get_cpu_data(0)->cpu_stack_top = (uintptr_t)_kstack_end;
+    get_cpu_data(0)->cpu_running = true;
 }
 
 void secondary_cpus_init(void)
 {
+    /* the boot processor came up before the firmware tables were parsed */
+    get_cpu_data(0)->cpu_node = numa_cpu_to_node(processor_array[0].apic_id);
+
+    for (uint32_t num = 1; num < processor_count; ++num) {
+        percpu_setup_area(num);
+        cpu_data_init(num);
+
+        uintptr_t stack = (uintptr_t)balloc(SECONDARY_STACK_SIZE + 16);
+        get_cpu_data(num)->cpu_stack_top =
+            ROUND_DOWN(stack + SECONDARY_STACK_SIZE + 16, 16);
+    }
+
+    num_cpus = processor_count;
 }
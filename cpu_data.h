@@ -5,26 +5,34 @@
 #include <stdint.h>
 #include <processor.h>
 #include <compiler.h>
+#include <percpu.h>
 #include <x86.h>
 
 /**
- * CPU-specific data. Each CPU in SMP holds this struct.
- * Use the get_current_cpu_data() function to get this struct
- * for the current CPU.
+ * CPU-specific data. Each CPU in SMP holds this struct at the start of
+ * its per-CPU area. Use the get_current_cpu_data() function to get this
+ * struct for the current CPU.
  */
 typedef struct cpu_data {
-    uint32_t cpu_number;
-    thread_t cpu_current_thread;
+    uint32_t  cpu_number;
+    thread_t *cpu_current_thread;
 
     processor_t *cpu_processor;
 
-    uint8_t cpu_lapic_id;
-    uint8_t cpu_lapic_version;
+    uint32_t cpu_lapic_id;
+    uint8_t  cpu_lapic_version;
+
+    uint32_t cpu_node; /* NUMA node of the processor. */
+
+    uintptr_t cpu_stack_top; /* Stack the CPU boots and idles on. */
 
     bool cpu_running;
 } cpu_data_t;
 
+DECLARE_PER_CPU(cpu_data_t, cpu_data);
+
 extern cpu_data_t *cpu_data_ptr[];
+extern size_t      num_cpus;
 
 /**
  * Initialize the cpu data for boot processor.
@@ -32,8 +40,10 @@ extern cpu_data_t *cpu_data_ptr[];
 void boot_cpu_init(void);
 
 /**
- * Called once by the boot processor after VM and heap is online to
- * initialize the cpu data for secondary processors.
+ * Called once by the boot processor after the platform code registered
+ * all processors to initialize the cpu data for secondary processors.
+ * Uses the boot allocator, so it must run before the PMM takes over the
+ * physical memory.
  */
 void secondary_cpus_init(void);
 
@@ -51,7 +61,7 @@ static inline cpu_data_t *get_cpu_data(uint32_t cpu)
 
 static inline cpu_data_t *get_current_cpu_data(void)
 {
-    return (cpu_data_t *)x86_get_gs_offset(__offsetof(cpu_data_t, cpu_number));
+    return this_cpu_ptr(cpu_data);
 }
 
 static inline thread_t *get_current_thread()
@@ -64,3 +74,8 @@ static inline uint32_t get_current_cpu_number(void)
 {
     return (uint32_t)x86_get_gs_offset(__offsetof(cpu_data_t, cpu_number));
 }
+
+static inline uint32_t get_current_cpu_node(void)
+{
+    return (uint32_t)x86_get_gs_offset(__offsetof(cpu_data_t, cpu_node));
+}
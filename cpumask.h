@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <percpu.h>
+
+/**
+ * Set of CPUs, one bit per CPU number. MAX_NCPUS fits a single word.
+ */
+typedef uint64_t cpu_mask_t;
+
+#define CPU_MASK_NONE   ((cpu_mask_t)0)
+#define CPU_MASK_ALL    (~(cpu_mask_t)0)
+#define CPU_MASK(cpu)   ((cpu_mask_t)1 << (cpu))
+
+static inline bool cpu_mask_test(cpu_mask_t mask, uint32_t cpu)
+{
+    return mask & CPU_MASK(cpu);
+}
+
+static inline uint32_t cpu_mask_weight(cpu_mask_t mask)
+{
+    uint32_t weight = 0;
+
+    /* no libgcc to back __builtin_popcountll without POPCNT */
+    for (; mask; mask &= mask - 1) {
+        weight++;
+    }
+    return weight;
+}
+
+/**
+ * Iterate over the CPUs of a mask in ascending order.
+ */
+#define for_each_cpu_in_mask(cpu, mask)                                        \
+    for (cpu_mask_t __m = (mask);                                              \
+         __m && ((cpu) = __builtin_ctzll(__m), 1); __m &= __m - 1)
@@ -1,9 +1,10 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <x86.h>
+#include <uart.h>
 
 void platform_init_debug(void)
 {
-    /* disable all interrrupts */
-    ;
+    /* serial console, polled until the interrupt controllers are up */
+    uart_init();
 }
@@ -2,6 +2,7 @@
 
 #include "x86.h"
 #include <init.h>
+#include <console/kprint.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -50,9 +51,9 @@ void __init_func kernel_init_upto(init_stage_t upto_stage)
 
     while (cur_hook < __init_hooks_end && cur_hook->stage <= upto_stage) {
         if (stage >= INIT_STAGE_KPRINTF) {
-            /* kprintf("%s[%d]: %p(%p)", __func__, cur_hook->stage,
-             * cur_hook->hook, */
-            /*         cur_hook->args); */
+            kprintf(KLOG_LEVEL_DEBUG, "%s[%d]: %s %p(%p)\n", __func__,
+                    cur_hook->stage, cur_hook->name, cur_hook->hook,
+                    cur_hook->args);
         }
         stage = cur_hook->stage - 1;
         cur_hook->hook(cur_hook->args);
@@ -60,12 +61,23 @@ void __init_func kernel_init_upto(init_stage_t upto_stage)
     }
 
     if (upto_stage >= INIT_STAGE_KPRINTF) {
-        /* kprintf("reached stage %d\n", upto_stage); */
+        kprintf(KLOG_LEVEL_DEBUG, "reached stage %d\n", upto_stage);
     }
 
     stage = upto_stage;
 }
 
+void __init_func kernel_init_percpu(void)
+{
+    init_stage_hook_t *hook;
+
+    for (hook = __init_hooks_start; hook < __init_hooks_end; ++hook) {
+        if (hook->stage == INIT_STAGE_PERCPU) {
+            hook->hook(hook->args);
+        }
+    }
+}
+
 void __init_func init_test1()
 {
     /* __asm__ volatile("int3"); */
@@ -77,3 +77,10 @@ void kernel_init_upto(init_stage_t upto_stage);
  * Initializes the kernel init stage hook system.
  */
 void init_hooks_init(void);
+
+/**
+ * Calls the hooks registered at the PERCPU stage on the calling processor.
+ * The boot processor runs them through kernel_init_upto(), every other
+ * processor calls this while it comes up.
+ */
+void kernel_init_percpu(void);
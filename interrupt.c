@@ -2,15 +2,19 @@
 
 #include <x86.h>
 #include <apic.h>
+#include <counters.h>
+#include <cpu_data.h>
 #include <platform.h>
+#include <percpu.h>
+#include <pic.h>
+#include <scheduler.h>
+#include <softirq.h>
+#include <spinlock.h>
+#include <stdlib.h>
+#include <trace.h>
 
 #define NUM_ISR 256
 
-/**
- * An interrupt service routine.
- */
-typedef void (*isr_ptr_t)(void *arg);
-
 /**
  * Represents a single entry in the interrupt handler table.
  */
@@ -22,6 +26,13 @@ typedef struct int_table_entry {
                              * allocated.
                              */
     uint32_t edge      : 1; /* Edge(1)/Level(0) triggered. */
+
+    /* device interrupts only */
+    irq_route_t route;       /* Retargets the interrupt. */
+    void       *route_data;
+    uint32_t    block;       /* Vectors moved along, this one included. */
+    cpu_mask_t  affinity;    /* CPUs the interrupt may be sent to. */
+    uint32_t    target;      /* CPU it is sent to. */
 } int_table_entry_t;
 
 /**
@@ -29,25 +40,65 @@ typedef struct int_table_entry {
  */
 static int_table_entry_t int_table[NUM_ISR];
 
+/* irq.c */
+DECLARE_COUNTER_ARRAY(interrupts, NUM_ISR);
+
+/* serializes the routing changes and the vector allocation */
+static spin_lock_t irq_route_lock;
+
+cpu_mask_t irq_default_affinity = CPU_MASK_ALL;
+
+/* interrupts nest while the deferred work runs with them enabled */
+DEFINE_PER_CPU(uint32_t, irq_nesting);
+
 void platform_init_interrupts(void)
 {
+    /* everything goes through the APICs */
+    pic_init();
 }
 
-void platform_int_handler(x86_interrupt_frame_t *frame)
+void platform_irq_handler(uint64_t vector)
 {
-    uint32_t           vector = frame->vector;
     int_table_entry_t *handler = &int_table[vector];
 
-    /* edge triggered interrupt */
-    if (handler->edge) {}
+    counter_inc_idx(interrupts, vector);
+    TRACEPOINT(irq, "vector %llu", vector);
+
+    /* a spurious interrupt is not in service, it must not be acknowledged */
+    if (vector == LAPIC_SPURIOUS_VECTOR) {
+        return;
+    }
+
+    this_cpu_inc(irq_nesting);
+
+    /* edge triggered interrupt, acknowledge early so that the next one
+     * can be latched while the handler runs */
+    if (handler->edge) {
+        lapic_eoi();
+    }
 
     /* invoke the registered callback */
     if (handler->callback) {
         handler->callback(handler->arg);
     }
 
-    /* level triggered interrupt */
-    if (!handler->edge) {}
+    /* level triggered interrupt, acknowledge once the source is quiet */
+    if (!handler->edge) {
+        lapic_eoi();
+    }
+
+    /* deferred work only on the outermost exit */
+    if (this_cpu_read(irq_nesting) == 1) {
+        softirq_irq_exit();
+    }
+
+    this_cpu_dec(irq_nesting);
+
+    /* a nested interrupt cannot switch threads under the outer handler or
+     * the softirq handlers it interrupted */
+    if (!this_cpu_read(irq_nesting) && !softirq_active()) {
+        thread_preempt();
+    }
 }
 
 void register_isr(uint32_t vector, isr_ptr_t callback, bool edge)
@@ -56,3 +107,172 @@ void register_isr(uint32_t vector, isr_ptr_t callback, bool edge)
     int_table[vector].allocated = true;
     int_table[vector].edge = edge;
 }
+
+int irq_alloc_vectors(uint32_t count)
+{
+    uint64_t flags;
+    int      first = -1;
+
+    spin_lock_lock_irqsave(&irq_route_lock, &flags);
+
+    for (uint32_t vector = ROUND_UP(IRQ_DYNAMIC_VECTOR_FIRST, count);
+         vector + count - 1 <= IRQ_DYNAMIC_VECTOR_LAST; vector += count) {
+        uint32_t i;
+        for (i = 0; i < count && !int_table[vector + i].allocated; ++i) {
+        }
+
+        if (i == count) {
+            for (i = 0; i < count; ++i) {
+                int_table[vector + i].allocated = true;
+            }
+            first = vector;
+            break;
+        }
+    }
+
+    spin_lock_unlock_irqrestore(&irq_route_lock, flags);
+    return first;
+}
+
+void irq_free_vectors(uint32_t vector, uint32_t count)
+{
+    uint64_t flags;
+
+    spin_lock_lock_irqsave(&irq_route_lock, &flags);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        int_table[vector + i] = (int_table_entry_t){0};
+    }
+
+    spin_lock_unlock_irqrestore(&irq_route_lock, flags);
+}
+
+static bool irq_cpu_online(uint32_t cpu)
+{
+    return cpu < num_cpus && get_cpu_data(cpu)->cpu_running;
+}
+
+/* irq_route_lock held */
+static bool irq_route_to(int_table_entry_t *entry, uint32_t vector,
+                         uint32_t cpu)
+{
+    if (!irq_cpu_online(cpu) || !cpu_mask_test(entry->affinity, cpu)) {
+        return false;
+    }
+
+    if (!entry->route(vector, get_cpu_data(cpu)->cpu_lapic_id,
+                      entry->route_data)) {
+        return false;
+    }
+
+    /* the rest of the block shares the routing hardware */
+    for (uint32_t i = 0; i < entry->block; ++i) {
+        entry[i].affinity = entry->affinity;
+        entry[i].target = cpu;
+    }
+    return true;
+}
+
+/* first CPU of the affinity the interrupt can be sent to, irq_route_lock
+ * held */
+static bool irq_route_any(int_table_entry_t *entry, uint32_t vector)
+{
+    uint32_t cpu;
+
+    if (irq_route_to(entry, vector, entry->target)) {
+        return true;
+    }
+
+    for_each_cpu_in_mask (cpu, entry->affinity) {
+        if (irq_route_to(entry, vector, cpu)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void irq_set_route(uint32_t vector, irq_route_t route, void *data)
+{
+    irq_set_route_block(vector, 1, route, data);
+}
+
+void irq_set_route_block(uint32_t vector, uint32_t count, irq_route_t route,
+                         void *data)
+{
+    int_table_entry_t *entry = &int_table[vector];
+    uint64_t           flags;
+
+    spin_lock_lock_irqsave(&irq_route_lock, &flags);
+
+    entry->route = route;
+    entry->route_data = data;
+    entry->block = count;
+    entry->affinity = irq_default_affinity;
+    entry->target = 0;
+
+    /* the boot processor takes what nothing else can */
+    if (!irq_route_any(entry, vector)) {
+        entry->affinity |= CPU_MASK(0);
+        irq_route_to(entry, vector, 0);
+    }
+
+    spin_lock_unlock_irqrestore(&irq_route_lock, flags);
+}
+
+bool irq_set_affinity(uint32_t vector, cpu_mask_t mask)
+{
+    int_table_entry_t *entry = &int_table[vector];
+    uint64_t           flags;
+    bool               ok = false;
+
+    spin_lock_lock_irqsave(&irq_route_lock, &flags);
+
+    if (entry->route) {
+        cpu_mask_t old = entry->affinity;
+
+        entry->affinity = mask;
+        ok = irq_route_any(entry, vector);
+        if (!ok) {
+            entry->affinity = old;
+        }
+    }
+
+    spin_lock_unlock_irqrestore(&irq_route_lock, flags);
+    return ok;
+}
+
+cpu_mask_t irq_get_affinity(uint32_t vector)
+{
+    return int_table[vector].affinity;
+}
+
+bool irq_is_routable(uint32_t vector)
+{
+    return int_table[vector].route;
+}
+
+uint32_t irq_route_block_size(uint32_t vector)
+{
+    return int_table[vector].route ? int_table[vector].block : 0;
+}
+
+uint32_t irq_get_target(uint32_t vector)
+{
+    return int_table[vector].target;
+}
+
+bool irq_set_target(uint32_t vector, uint32_t cpu)
+{
+    int_table_entry_t *entry = &int_table[vector];
+    uint64_t           flags;
+    bool               ok = false;
+
+    spin_lock_lock_irqsave(&irq_route_lock, &flags);
+
+    if (entry->route) {
+        ok = irq_route_to(entry, vector, cpu);
+    }
+
+    spin_lock_unlock_irqrestore(&irq_route_lock, flags);
+    return ok;
+}
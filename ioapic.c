@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <ioapic.h>
+#include <acpi.h>
+#include <mmu.h>
+#include <platform.h>
+#include <spinlock.h>
+
+/* indirect register access */
+#define IOAPIC_REGSEL          0x00
+#define IOAPIC_WINDOW          0x10
+
+#define IOAPIC_REG_VERSION     0x01
+#define IOAPIC_REG_REDTBL(n)   (0x10 + 2 * (n))
+
+/* redirection table entry, low dword */
+#define IOAPIC_RTE_ACTIVE_LOW  (1 << 13)
+#define IOAPIC_RTE_LEVEL       (1 << 15)
+#define IOAPIC_RTE_MASKED      (1 << 16)
+
+/* redirection table entry, high dword */
+#define IOAPIC_RTE_DEST_SHIFT  24
+
+/* interrupt source override flags */
+#define ACPI_ISO_POLARITY_MASK 0x3
+#define ACPI_ISO_ACTIVE_LOW    0x3
+#define ACPI_ISO_TRIGGER_MASK  0xc
+#define ACPI_ISO_LEVEL         0xc
+
+typedef struct ioapic {
+    volatile uint32_t *base;
+    uint32_t           gsi_base;
+    uint32_t           count; /* Redirection entries. */
+} ioapic_t;
+
+static ioapic_t    ioapics[ACPI_MAX_IOAPICS];
+static uint32_t    ioapic_count;
+static spin_lock_t ioapic_lock;
+
+static uint32_t ioapic_read(ioapic_t *io, uint32_t reg)
+{
+    io->base[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    return io->base[IOAPIC_WINDOW / sizeof(uint32_t)];
+}
+
+static void ioapic_write(ioapic_t *io, uint32_t reg, uint32_t val)
+{
+    io->base[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    io->base[IOAPIC_WINDOW / sizeof(uint32_t)] = val;
+}
+
+/* IOAPIC handling the interrupt and the input pin it arrives at */
+static ioapic_t *ioapic_for_gsi(uint32_t gsi, uint32_t *pin)
+{
+    for (uint32_t i = 0; i < ioapic_count; ++i) {
+        ioapic_t *io = &ioapics[i];
+
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->count) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return NULL;
+}
+
+void ioapic_init(void)
+{
+    for (uint32_t i = 0; i < acpi_ioapic_count; ++i) {
+        ioapic_t *io = &ioapics[ioapic_count];
+
+        io->base = x86_mmu_map_mmio(acpi_ioapics[i].addr);
+        if (!io->base) {
+            continue;
+        }
+        io->gsi_base = acpi_ioapics[i].gsi_base;
+        io->count = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xff) + 1;
+
+        for (uint32_t pin = 0; pin < io->count; ++pin) {
+            ioapic_write(io, IOAPIC_REG_REDTBL(pin), IOAPIC_RTE_MASKED);
+            ioapic_write(io, IOAPIC_REG_REDTBL(pin) + 1, 0);
+        }
+
+        ioapic_count++;
+    }
+}
+
+uint32_t ioapic_isa_to_gsi(uint8_t irq, bool *level, bool *active_low)
+{
+    /* ISA interrupts are edge triggered and active high */
+    *level = false;
+    *active_low = false;
+
+    for (uint32_t i = 0; i < acpi_iso_count; ++i) {
+        acpi_iso_t *iso = &acpi_isos[i];
+
+        if (iso->source != irq) {
+            continue;
+        }
+
+        *level = (iso->flags & ACPI_ISO_TRIGGER_MASK) == ACPI_ISO_LEVEL;
+        *active_low =
+            (iso->flags & ACPI_ISO_POLARITY_MASK) == ACPI_ISO_ACTIVE_LOW;
+        return iso->gsi;
+    }
+
+    return irq;
+}
+
+/* moves the interrupt to another processor as the affinity changes */
+static bool ioapic_route(uint32_t vector, uint32_t apic_id, void *data)
+{
+    uint32_t  gsi = (uintptr_t)data;
+    uint32_t  pin;
+    ioapic_t *io = ioapic_for_gsi(gsi, &pin);
+    uint64_t  flags;
+
+    /* the destination field has 8 bits without interrupt remapping */
+    if (apic_id > 0xff) {
+        return false;
+    }
+
+    spin_lock_lock_irqsave(&ioapic_lock, &flags);
+    ioapic_write(io, IOAPIC_REG_REDTBL(pin) + 1,
+                 apic_id << IOAPIC_RTE_DEST_SHIFT);
+    spin_lock_unlock_irqrestore(&ioapic_lock, flags);
+
+    return true;
+}
+
+bool ioapic_map_gsi(uint32_t gsi, uint8_t vector, bool level,
+                    bool active_low)
+{
+    uint32_t  pin;
+    ioapic_t *io = ioapic_for_gsi(gsi, &pin);
+    if (!io) {
+        return false;
+    }
+
+    uint32_t low = vector | IOAPIC_RTE_MASKED;
+    if (level) {
+        low |= IOAPIC_RTE_LEVEL;
+    }
+    if (active_low) {
+        low |= IOAPIC_RTE_ACTIVE_LOW;
+    }
+
+    uint64_t flags;
+    spin_lock_lock_irqsave(&ioapic_lock, &flags);
+    ioapic_write(io, IOAPIC_REG_REDTBL(pin), low);
+    spin_lock_unlock_irqrestore(&ioapic_lock, flags);
+
+    /* sets the destination */
+    irq_set_route(vector, ioapic_route, (void *)(uintptr_t)gsi);
+
+    ioapic_unmask_gsi(gsi);
+    return true;
+}
+
+static void ioapic_set_mask(uint32_t gsi, bool masked)
+{
+    uint32_t  pin;
+    ioapic_t *io = ioapic_for_gsi(gsi, &pin);
+    uint64_t  flags;
+
+    if (!io) {
+        return;
+    }
+
+    spin_lock_lock_irqsave(&ioapic_lock, &flags);
+
+    uint32_t low = ioapic_read(io, IOAPIC_REG_REDTBL(pin));
+    if (masked) {
+        low |= IOAPIC_RTE_MASKED;
+    }
+    else {
+        low &= ~IOAPIC_RTE_MASKED;
+    }
+    ioapic_write(io, IOAPIC_REG_REDTBL(pin), low);
+
+    spin_lock_unlock_irqrestore(&ioapic_lock, flags);
+}
+
+void ioapic_mask_gsi(uint32_t gsi)
+{
+    ioapic_set_mask(gsi, true);
+}
+
+void ioapic_unmask_gsi(uint32_t gsi)
+{
+    ioapic_set_mask(gsi, false);
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Maps the IOAPICs listed in the MADT and masks all their inputs. Called
+ * once on the boot processor after the MADT was parsed.
+ */
+void ioapic_init(void);
+
+/**
+ * Global system interrupt a legacy ISA IRQ is wired to, following the
+ * interrupt source overrides of the MADT.
+ *
+ * @param irq ISA IRQ number.
+ *
+ * @param level Set to whether the interrupt is level triggered.
+ *
+ * @param active_low Set to whether the interrupt is active low.
+ *
+ * @return Global system interrupt number.
+ */
+uint32_t ioapic_isa_to_gsi(uint8_t irq, bool *level, bool *active_low);
+
+/**
+ * Routes a global system interrupt to a vector and unmasks it. The target
+ * CPU follows the affinity of the vector (see irq_set_affinity()), the
+ * handler is installed separately with register_isr().
+ *
+ * @param gsi Global system interrupt.
+ *
+ * @param vector Interrupt vector.
+ *
+ * @param level Level triggered if true, edge triggered otherwise.
+ *
+ * @param active_low Active low if true, active high otherwise.
+ *
+ * @return false if no IOAPIC handles the interrupt.
+ */
+bool ioapic_map_gsi(uint32_t gsi, uint8_t vector, bool level,
+                    bool active_low);
+
+/**
+ * Masks a global system interrupt.
+ */
+void ioapic_mask_gsi(uint32_t gsi);
+
+/**
+ * Unmasks a global system interrupt.
+ */
+void ioapic_unmask_gsi(uint32_t gsi);
@@ -3,16 +3,24 @@
 #include <types.h>
 #include <x86.h>
 #include <platform.h>
+#include <counters.h>
+
+#define NUM_ISR         256
 
 #define INT_DIV_BY_ZERO 0x0
 #define INT_PAGE_FAULT  0xE
 
+DEFINE_COUNTER_ARRAY(interrupts, NUM_ISR, "interrupts taken per vector");
+DEFINE_COUNTER(page_faults, "page faults");
+
 void x86_div_by_zero_exception_handler(void)
 {
 }
 
 void x86_page_fault_exception_handler(x86_interrupt_frame_t *frame)
 {
+    counter_inc(page_faults);
+
     /* vaddr_t fault_vaddr = x86_get_cr2(); */
 }
 
@@ -20,6 +28,8 @@ void x86_int_handler(x86_interrupt_frame_t *frame)
 {
     uint32_t vector = frame->vector;
 
+    counter_inc_idx(interrupts, vector);
+
     switch (vector) {
     case INT_DIV_BY_ZERO:
         x86_div_by_zero_exception_handler();
@@ -29,11 +39,8 @@ void x86_int_handler(x86_interrupt_frame_t *frame)
         x86_page_fault_exception_handler(frame);
         break;
 
+    /* vectors from 0x20 up enter through platform_irq_handler() */
     default:
         break;
-
-    case 0x20 ... 0xff:
-        platform_int_handler(frame);
-        break;
     }
 }
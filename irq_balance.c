@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <platform.h>
+#include <clock.h>
+#include <counters.h>
+#include <cpu_data.h>
+#include <timer.h>
+#include <workqueue.h>
+
+#define NUM_ISR                 256
+#define IRQ_FIRST_DEVICE_VECTOR 0x20
+
+/* time between two passes */
+#define IRQ_BALANCE_INTERVAL_NS NSEC_PER_SEC
+
+/* interrupts per interval a move has to save on the old CPU */
+#define IRQ_BALANCE_MIN_GAIN    100
+
+extern void qsort(void *arr, size_t n, size_t es,
+                  int (*cmp)(const void *, const void *));
+
+typedef struct irq_load {
+    uint32_t vector;
+    uint64_t rate; /* Interrupts during the last interval. */
+} irq_load_t;
+
+static const counter_t *irq_counter;
+static uint64_t         irq_last_count[NUM_ISR];
+
+static void irq_balance_tick(timer_t *timer, void *arg);
+
+static bool    irq_balance_on;
+static timer_t irq_balance_timer = TIMER_INITIAL_VALUE(irq_balance_timer);
+static work_t  irq_balance_work;
+
+/* busiest first */
+static int irq_load_cmp(const void *a, const void *b)
+{
+    const irq_load_t *x = a;
+    const irq_load_t *y = b;
+
+    if (x->rate == y->rate) {
+        return 0;
+    }
+    return x->rate > y->rate ? -1 : 1;
+}
+
+/*
+ * Greedy placement, the busiest interrupts first, each on the least loaded
+ * CPU it may go to. An interrupt stays where it is unless the move takes a
+ * noticeable load off its current CPU.
+ */
+static void irq_balance(work_t *work)
+{
+    static irq_load_t loads[NUM_ISR];
+    uint64_t          cpu_load[MAX_NCPUS] = {0};
+    uint32_t          count = 0;
+
+    for (uint32_t vector = IRQ_FIRST_DEVICE_VECTOR; vector < NUM_ISR;
+         ++vector) {
+        uint32_t block = irq_route_block_size(vector);
+        uint64_t total = 0;
+
+        if (!block) {
+            continue;
+        }
+
+        /* a block lands on one CPU, it weighs as much as all its vectors */
+        for (uint32_t i = 0; i < block; ++i) {
+            total += counter_read(irq_counter, vector + i);
+        }
+        loads[count].vector = vector;
+        loads[count].rate = total - irq_last_count[vector];
+        irq_last_count[vector] = total;
+        count++;
+    }
+
+    qsort(loads, count, sizeof(loads[0]), irq_load_cmp);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t vector = loads[i].vector;
+        uint32_t target = irq_get_target(vector);
+        uint32_t best = target;
+        uint32_t cpu;
+
+        for_each_cpu_in_mask (cpu, irq_get_affinity(vector)) {
+            if (cpu >= num_cpus || !get_cpu_data(cpu)->cpu_running) {
+                continue;
+            }
+            if (cpu_load[cpu] < cpu_load[best]) {
+                best = cpu;
+            }
+        }
+
+        if (best != target &&
+            cpu_load[best] + IRQ_BALANCE_MIN_GAIN <= cpu_load[target] &&
+            irq_set_target(vector, best)) {
+            target = best;
+        }
+
+        cpu_load[target] += loads[i].rate;
+    }
+
+    if (__atomic_load_n(&irq_balance_on, __ATOMIC_ACQUIRE)) {
+        timer_set_oneshot(&irq_balance_timer, IRQ_BALANCE_INTERVAL_NS,
+                          irq_balance_tick, NULL);
+    }
+}
+
+/* the pass reroutes interrupts under locks, leave it to a worker */
+static void irq_balance_tick(timer_t *timer, void *arg)
+{
+    queue_work(system_wq, &irq_balance_work);
+}
+
+void irq_balance_enable(bool enable)
+{
+    if (!irq_counter) {
+        irq_counter = counter_find("interrupts");
+        work_init(&irq_balance_work, irq_balance);
+    }
+
+    __atomic_store_n(&irq_balance_on, enable, __ATOMIC_RELEASE);
+
+    if (enable) {
+        timer_set_oneshot(&irq_balance_timer, IRQ_BALANCE_INTERVAL_NS,
+                          irq_balance_tick, NULL);
+    }
+    else {
+        timer_cancel(&irq_balance_timer);
+    }
+}
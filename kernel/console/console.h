@@ -51,8 +51,26 @@ typedef struct console {
     void (*setup)(struct console *con);
     void (*exit)(struct console *con);
 
+    /* position in the kernel log written up to, a new console starts with
+     * whatever the log still holds */
+    uint64_t log_pos;
+
     struct console *next;
 } console_t;
 
 void register_console(console_t *con);
 void unregister_console(console_t *con);
+
+/**
+ * Writes the committed records of the kernel log to every registered
+ * console and releases the ones all of them have written. Returns right
+ * away if another CPU is already draining. Normally only called by the
+ * console thread, which kprintf() wakes up.
+ */
+void console_drain(void);
+
+/**
+ * Synchronously writes the records each console has not written yet,
+ * ignoring whoever else may be draining. Only for panics.
+ */
+void console_emergency_flush(void);
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <console/console_ring_buf.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The consumer zeroes every byte it releases, so a header location that a
+ * producer has reserved but not committed always reads CONSOLE_RECORD_FREE
+ * no matter what was stored there on the previous lap.
+ */
+
+void console_ring_init(console_ring_buffer_t *ring, void *data, size_t size)
+{
+    ring->data = data;
+    ring->size = size;
+    ring->head = 0;
+    ring->dropped = 0;
+    ring->tail = 0;
+}
+
+console_record_t *console_ring_reserve(console_ring_buffer_t *ring, size_t len)
+{
+    size_t   need = ALIGN(sizeof(console_record_t) + len, CONSOLE_RING_ALIGN);
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t pad;
+
+    /* a record never wraps, so it can take at most half of the ring */
+    if (len > UINT16_MAX || need > ring->size / 2) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    do {
+        uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        size_t   offset = head & (ring->size - 1);
+
+        /* skip the end of the buffer if the record does not fit there */
+        pad = (offset + need > ring->size) ? ring->size - offset : 0;
+
+        if (head + pad + need - tail > ring->size) {
+            __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->head, &head,
+                                          head + pad + need, true,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+    if (pad) {
+        console_record_t *filler =
+            (console_record_t *)(ring->data + (head & (ring->size - 1)));
+
+        /* only size and state fit in the smallest padding */
+        filler->size = pad;
+        __atomic_store_n(&filler->state, CONSOLE_RECORD_PADDING,
+                         __ATOMIC_RELEASE);
+        head += pad;
+    }
+
+    console_record_t *rec =
+        (console_record_t *)(ring->data + (head & (ring->size - 1)));
+    rec->size = need;
+    rec->len = len;
+
+    return rec;
+}
+
+void console_ring_commit(console_ring_buffer_t *ring, console_record_t *rec)
+{
+    __atomic_store_n(&rec->state, CONSOLE_RECORD_COMMITTED, __ATOMIC_RELEASE);
+}
+
+console_record_t *console_ring_at(console_ring_buffer_t *ring,
+                                  uint64_t              *pos)
+{
+    while (1) {
+        if (*pos == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+
+        console_record_t *rec =
+            (console_record_t *)(ring->data + (*pos & (ring->size - 1)));
+        uint32_t state = __atomic_load_n(&rec->state, __ATOMIC_ACQUIRE);
+
+        if (state == CONSOLE_RECORD_PADDING) {
+            *pos += rec->size;
+            continue;
+        }
+
+        /* reserved but not committed yet, the records behind it wait */
+        if (state != CONSOLE_RECORD_COMMITTED) {
+            return NULL;
+        }
+
+        return rec;
+    }
+}
+
+console_record_t *console_ring_peek(console_ring_buffer_t *ring)
+{
+    uint64_t          pos = ring->tail;
+    console_record_t *rec = console_ring_at(ring, &pos);
+
+    /* drop the padding that was skipped */
+    console_ring_release(ring, pos);
+
+    return rec;
+}
+
+void console_ring_consume(console_ring_buffer_t *ring, console_record_t *rec)
+{
+    uint32_t size = rec->size;
+
+    memset(rec, 0, size);
+    __atomic_store_n(&ring->tail, ring->tail + size, __ATOMIC_RELEASE);
+}
+
+void console_ring_release(console_ring_buffer_t *ring, uint64_t pos)
+{
+    while (ring->tail < pos) {
+        console_ring_consume(
+            ring, (console_record_t *)(ring->data +
+                                       (ring->tail & (ring->size - 1))));
+    }
+}
@@ -3,9 +3,114 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <compiler.h>
+
+/* records start on 8-byte boundaries */
+#define CONSOLE_RING_ALIGN       8
+
+/* record states */
+#define CONSOLE_RECORD_FREE      0
+#define CONSOLE_RECORD_COMMITTED 0x434d4954 /* "CMIT" */
+#define CONSOLE_RECORD_PADDING   0x50414444 /* "PADD" */
+
+/**
+ * A log record. The text is not NUL terminated.
+ */
+typedef struct console_record {
+    uint32_t size;      /* Size of the record including the header. */
+    uint32_t state;     /* Published with a release store on commit. */
+    uint64_t timestamp; /* Monotonic time in nanoseconds. */
+    uint16_t len;       /* Length of the text. */
+    uint8_t  level;     /* KLOG_LEVEL_*. */
+    uint8_t  cpu;       /* CPU the record was written on. */
+    uint32_t reserved;
+    char     text[];
+} console_record_t;
 
 /**
  * Console ring buffer.
+ *
+ * Multiple producers, one consumer. A producer reserves a record with a
+ * single compare-and-swap of the head, fills it in and commits it, so any
+ * CPU can log from any context, interrupt handlers included, without taking
+ * a lock. The consumer drains the records in reservation order and stops at
+ * the first one that has not been committed yet. When the ring is full new
+ * records are dropped and counted rather than waiting for the consumer.
+ *
+ * head and tail are running byte counts, the offset in the buffer is the
+ * count modulo the size.
  */
 typedef struct console_ring_buffer {
+    uint8_t *data;
+    size_t   size; /* Power of two. */
+
+    uint64_t head __aligned(64); /* Next byte to reserve. */
+    uint64_t dropped;            /* Records that did not fit. */
+
+    uint64_t tail __aligned(64); /* Oldest byte not consumed. */
 } console_ring_buffer_t;
+
+/**
+ * Initializes an empty ring buffer.
+ *
+ * @param data Zeroed backing storage.
+ *
+ * @param size Size of the storage, a power of two.
+ */
+void console_ring_init(console_ring_buffer_t *ring, void *data, size_t size);
+
+/**
+ * Reserves a record. Never blocks.
+ *
+ * @param len Length of the text that is going to be written.
+ *
+ * @return Record whose text the caller fills in before committing it, or
+ * NULL if the ring is full.
+ */
+console_record_t *console_ring_reserve(console_ring_buffer_t *ring,
+                                       size_t                 len);
+
+/**
+ * Publishes a reserved record to the consumer.
+ */
+void console_ring_commit(console_ring_buffer_t *ring, console_record_t *rec);
+
+/**
+ * Returns the oldest record if it has been committed. Only called by the
+ * consumer.
+ */
+console_record_t *console_ring_peek(console_ring_buffer_t *ring);
+
+/**
+ * Releases the record returned by console_ring_peek() to the producers.
+ */
+void console_ring_consume(console_ring_buffer_t *ring, console_record_t *rec);
+
+/**
+ * Returns the committed record at a position between the tail and the head.
+ * Lets a reader walk the ring without consuming it. Only called by the
+ * consumer.
+ *
+ * @param pos Position of the record, moved past any padding in front of it.
+ * The caller advances it by the record size to get to the next one.
+ *
+ * @return Record or NULL if the position has not been committed yet.
+ */
+console_record_t *console_ring_at(console_ring_buffer_t *ring,
+                                  uint64_t /* in/out */ *pos);
+
+/**
+ * Releases every record before a position previously reached with
+ * console_ring_at().
+ */
+void console_ring_release(console_ring_buffer_t *ring, uint64_t pos);
+
+/**
+ * Number of records dropped so far because the ring was full.
+ */
+static inline uint64_t console_ring_dropped(console_ring_buffer_t *ring)
+{
+    return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
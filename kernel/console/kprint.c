@@ -1,4 +1,49 @@
+/* SPDX-License-Identifier: MIT */
+
 #include <console/console.h>
+#include <console/kprint.h>
+#include <clock.h>
+#include <cpu_data.h>
+#include <init.h>
+#include <percpu.h>
+#include <scheduler.h>
+#include <softirq.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread.h>
+#include <x86.h>
+
+#define KLOG_BUF_SIZE   (64 * 1024)
+
+/* the console thread also looks for records it was not woken up for */
+#define CONSOLE_POLL_MS 100
+
+static uint8_t klog_data[KLOG_BUF_SIZE] __aligned(64);
+
+/* statically initialized so that messages can be logged from the very
+ * start */
+console_ring_buffer_t klog_ring = {.data = klog_data, .size = KLOG_BUF_SIZE};
+
+/* set while a CPU drains the log, the ring has a single consumer */
+static bool klog_draining;
+
+/* everything that is compiled in is logged until told otherwise */
+uint8_t klog_levels[KLOG_NUM_SUBSYS] = {
+    [0 ... KLOG_NUM_SUBSYS - 1] = KLOG_COMPILE_LEVEL,
+};
+
+/* dropped count the consoles were last told about */
+static uint64_t klog_reported_drops;
+
+/* drains the log to the consoles so that the writers never wait on them */
+static thread_t *console_flusher;
+static tasklet_t console_kick_tasklet;
+
+/* set once the console thread has been woken up for new records */
+static bool klog_kick;
+
+/* the softirqs of the CPU are up, it may schedule the wakeup tasklet */
+static DEFINE_PER_CPU(bool, klog_kick_ready);
 
 /* List containing all the registered consoles. */
 static console_t *console_list;
@@ -51,3 +96,190 @@ void unregister_console(console_t *delcon)
         delcon->exit(delcon);
     }
 }
+
+int vkprintf(uint32_t level, const char *fmt, va_list args)
+{
+    char line[KLOG_LINE_MAX];
+    int  len = vsnprintf(line, sizeof(line), fmt, args);
+
+    if (len <= 0) {
+        return 0;
+    }
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+
+    console_record_t *rec = console_ring_reserve(&klog_ring, len);
+    if (!rec) {
+        return 0;
+    }
+
+    rec->timestamp = clock_monotonic_ns();
+    rec->level = level;
+    rec->cpu = get_current_cpu_number();
+    memcpy(rec->text, line, len);
+
+    console_ring_commit(&klog_ring, rec);
+
+    /* wake the console thread, once until it runs again */
+    if (this_cpu_read(klog_kick_ready) && console_flusher &&
+        !__atomic_exchange_n(&klog_kick, true, __ATOMIC_SEQ_CST)) {
+        tasklet_schedule(&console_kick_tasklet);
+    }
+
+    return len;
+}
+
+void klog_set_level(klog_subsys_t subsys, uint32_t level)
+{
+    if (subsys < KLOG_NUM_SUBSYS) {
+        __atomic_store_n(&klog_levels[subsys], level, __ATOMIC_RELAXED);
+    }
+}
+
+int __kprintf(uint32_t level, const char *fmt, ...)
+{
+    va_list ap;
+    int     i;
+
+    va_start(ap, fmt);
+    i = vkprintf(level, fmt, ap);
+    va_end(ap);
+
+    return i;
+}
+
+static void console_write_all(const uint8_t *text, size_t len)
+{
+    for (console_t *con = console_list; con != NULL; con = con->next) {
+        console_write(con, text, len);
+    }
+}
+
+/* writes the records a console has not seen yet, returns its new position */
+static uint64_t console_catch_up(console_t *con)
+{
+    uint64_t          pos = con->log_pos;
+    console_record_t *rec;
+
+    /* records released before the console was registered */
+    if (pos < klog_ring.tail) {
+        pos = klog_ring.tail;
+    }
+
+    while ((rec = console_ring_at(&klog_ring, &pos)) != NULL) {
+        console_write(con, (const uint8_t *)rec->text, rec->len);
+        pos += rec->size;
+    }
+
+    con->log_pos = pos;
+    return pos;
+}
+
+static void console_report_drops(void)
+{
+    uint64_t dropped = console_ring_dropped(&klog_ring);
+
+    if (dropped != klog_reported_drops) {
+        char msg[64];
+        int  len = snprintf(msg, sizeof(msg), "[%llu messages dropped]\n",
+                            dropped - klog_reported_drops);
+        if (len >= (int)sizeof(msg)) {
+            len = sizeof(msg) - 1;
+        }
+
+        klog_reported_drops = dropped;
+        console_write_all((const uint8_t *)msg, len);
+    }
+}
+
+void console_drain(void)
+{
+    /* somebody else is draining, the records will be picked up by them */
+    if (__atomic_exchange_n(&klog_draining, true, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    /* with no console yet the records are kept for the first one */
+    uint64_t oldest = klog_ring.tail;
+    bool     first = true;
+
+    for (console_t *con = console_list; con != NULL; con = con->next) {
+        uint64_t pos = console_catch_up(con);
+
+        if (first || pos < oldest) {
+            oldest = pos;
+        }
+        first = false;
+    }
+
+    console_ring_release(&klog_ring, oldest);
+    console_report_drops();
+
+    __atomic_store_n(&klog_draining, false, __ATOMIC_RELEASE);
+}
+
+void console_emergency_flush(void)
+{
+    /* the CPU that was draining may never come back, take over its role
+     * and leave the ring alone */
+    for (console_t *con = console_list; con != NULL; con = con->next) {
+        console_catch_up(con);
+    }
+}
+
+static void console_thread(void *arg)
+{
+    for (;;) {
+        __atomic_store_n(&klog_kick, false, __ATOMIC_SEQ_CST);
+
+        console_drain();
+
+        /* a kick that raced with the drain above is caught by the poll */
+        if (!__atomic_load_n(&klog_kick, __ATOMIC_SEQ_CST)) {
+            thread_sleep(CONSOLE_POLL_MS);
+        }
+    }
+}
+
+static void console_kick(void *arg)
+{
+    thread_unblock(console_flusher);
+}
+
+void panic(const char *fmt, ...)
+{
+    va_list ap;
+
+    x86_cli();
+
+    va_start(ap, fmt);
+    vkprintf(KLOG_LEVEL_CRITICAL, fmt, ap);
+    va_end(ap);
+
+    console_emergency_flush();
+
+    for (;;) {
+        x86_hlt();
+    }
+}
+
+static void console_percpu_init(const void *arg)
+{
+    /* the kernel log is drained by a single thread on the boot processor */
+    if (!console_flusher) {
+        tasklet_init(&console_kick_tasklet, console_kick, NULL);
+
+        console_flusher =
+            thread_create((uint8_t *)"kconsole", console_thread, NULL,
+                          LOWEST_PRIORITY + 1, NULL, 0);
+        if (console_flusher) {
+            thread_detach(console_flusher);
+        }
+    }
+
+    /* the tasklets of this CPU are usable from here on */
+    this_cpu_write(klog_kick_ready, true);
+}
+
+REGISTER_INIT_HOOK(console, PERCPU, 6, &console_percpu_init, NULL);
@@ -2,10 +2,95 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdarg.h>
+#include <compiler.h>
+#include <console/console_ring_buf.h>
+
 #define KLOG_LEVEL_CRITICAL 1
 #define KLOG_LEVEL_ERROR    2
 #define KLOG_LEVEL_WARN     3
 #define KLOG_LEVEL_INFO     4
 #define KLOG_LEVEL_DEBUG    5
 
-#define kprintf(level, fmt)
+/* longest message, anything past it is cut off */
+#define KLOG_LINE_MAX       256
+
+/**
+ * Kernel log, drained to the registered consoles.
+ */
+extern console_ring_buffer_t klog_ring;
+
+/*
+ * Most verbose level that is compiled in at all, override it with
+ * -DKLOG_COMPILE_LEVEL=...
+ */
+#ifndef KLOG_COMPILE_LEVEL
+#define KLOG_COMPILE_LEVEL KLOG_LEVEL_INFO
+#endif
+
+/**
+ * Subsystems whose log level is set separately at runtime. A source file
+ * picks its subsystem by defining KLOG_SUBSYS before including this header.
+ */
+typedef enum klog_subsys {
+    KLOG_SUBSYS_KERNEL,
+    KLOG_SUBSYS_MM,
+    KLOG_SUBSYS_SCHED,
+    KLOG_SUBSYS_IRQ,
+    KLOG_SUBSYS_TIMER,
+    KLOG_SUBSYS_SMP,
+    KLOG_SUBSYS_PCI,
+    KLOG_SUBSYS_CONSOLE,
+    KLOG_NUM_SUBSYS,
+} klog_subsys_t;
+
+#ifndef KLOG_SUBSYS
+#define KLOG_SUBSYS KLOG_SUBSYS_KERNEL
+#endif
+
+/**
+ * Most verbose level logged by each subsystem.
+ */
+extern uint8_t klog_levels[KLOG_NUM_SUBSYS];
+
+/**
+ * Logs a message of the given level for the subsystem of the calling file.
+ *
+ * A message more verbose than KLOG_COMPILE_LEVEL is folded away by the
+ * compiler along with its format string, its arguments are never
+ * evaluated. Otherwise the runtime level of the subsystem is checked with a
+ * single compare before any formatting is done.
+ *
+ * @param level KLOG_LEVEL_*, a constant.
+ */
+#define kprintf(level, fmt, ...)                                               \
+    do {                                                                       \
+        if ((level) <= KLOG_COMPILE_LEVEL &&                                   \
+            (level) <= klog_levels[KLOG_SUBSYS]) {                             \
+            __kprintf(level, fmt, ##__VA_ARGS__);                              \
+        }                                                                      \
+    } while (0)
+
+/**
+ * Sets the most verbose level a subsystem logs at runtime.
+ */
+void klog_set_level(klog_subsys_t subsys, uint32_t level);
+
+/**
+ * Formats a message into the kernel log unconditionally. Safe in any
+ * context, it neither blocks nor takes a lock. The message is dropped if
+ * the log is full.
+ *
+ * @param level KLOG_LEVEL_*.
+ *
+ * @return Number of characters logged.
+ */
+int __kprintf(uint32_t level, const char *fmt, ...) __printf(2, 3);
+int vkprintf(uint32_t level, const char *fmt, va_list args);
+
+/**
+ * Logs a critical message, writes out the kernel log synchronously and
+ * halts the calling CPU.
+ */
+void panic(const char *fmt, ...) __printf(1, 2) __noreturn;
@@ -6,6 +6,12 @@
 #include <types.h>
 #include <pgalloc.h>
 #include <stdlib.h>
+#include <counters.h>
+
+/* power of two size classes from 16 bytes up to 32 KiB, the last class
+ * counts every larger allocation */
+#define KHEAP_MIN_CLASS_SHIFT 4
+#define KHEAP_SIZE_CLASSES    13
 
 typedef struct free_heap_chunk {
     list_node_t node;
@@ -26,8 +32,25 @@ typedef struct alloc_struct {
 
 static heap_t kheap;
 
+DEFINE_COUNTER_ARRAY(kheap_allocs, KHEAP_SIZE_CLASSES,
+                     "heap allocations per size class");
+
+static uint32_t kheap_size_class(size_t size)
+{
+    if (size <= (1UL << KHEAP_MIN_CLASS_SHIFT)) {
+        return 0;
+    }
+
+    /* ceil(log2(size)) relative to the smallest class */
+    uint32_t shift = 64 - __builtin_clzl(size - 1);
+    uint32_t class = shift - KHEAP_MIN_CLASS_SHIFT;
+
+    return class < KHEAP_SIZE_CLASSES ? class : KHEAP_SIZE_CLASSES - 1;
+}
+
 void *kheap_malloc(size_t size)
 {
+    counter_inc_idx(kheap_allocs, kheap_size_class(size));
 }
 
 void *kheap_calloc(size_t count, size_t size)
@@ -1,10 +1,279 @@
 /* SPDX-License-Identifier: MIT */
+
 #include <apic.h>
+#include <clock.h>
+#include <mmu.h>
+#include <pit.h>
+#include <x86.h>
+
+/* Local APIC registers */
+#define LAPIC_REG_ID              0x020
+#define LAPIC_REG_VERSION         0x030
+#define LAPIC_REG_TPR             0x080
+#define LAPIC_REG_EOI             0x0b0
+#define LAPIC_REG_SVR             0x0f0
+#define LAPIC_REG_ESR             0x280
+#define LAPIC_REG_ICR_LO          0x300
+#define LAPIC_REG_ICR_HI          0x310
+#define LAPIC_REG_LVT_TIMER       0x320
+#define LAPIC_REG_TIMER_INITIAL   0x380
+#define LAPIC_REG_TIMER_CURRENT   0x390
+#define LAPIC_REG_TIMER_DIVIDE    0x3e0
+
+/* x2APIC registers are MSRs at X86_IA32_MSR_X2APIC_BASE + (reg >> 4) */
+#define X2APIC_MSR(reg)           (X86_IA32_MSR_X2APIC_BASE + ((reg) >> 4))
+
+/* Spurious interrupt vector register */
+#define LAPIC_SVR_ENABLE          0x100
+
+/* Interrupt command register */
+#define LAPIC_ICR_DM_FIXED        0x00000 /* Fixed delivery mode */
+#define LAPIC_ICR_DM_INIT         0x00500 /* INIT delivery mode */
+#define LAPIC_ICR_DM_STARTUP      0x00600 /* STARTUP delivery mode */
+#define LAPIC_ICR_DELIVERY_STATUS 0x01000 /* Send pending */
+#define LAPIC_ICR_LEVEL_ASSERT    0x04000
+#define LAPIC_ICR_TRIGGER_LEVEL   0x08000
+#define LAPIC_ICR_ALL_BUT_SELF    0xc0000 /* Destination shorthand */
+
+#define LAPIC_ICR_DEST_SHIFT      24
+
+/* Local vector table */
+#define LAPIC_LVT_MASKED          0x10000
+#define LAPIC_LVT_TIMER_ONESHOT   0x00000
+#define LAPIC_LVT_TIMER_DEADLINE  0x40000
+
+/* divide the bus clock by 16 */
+#define LAPIC_TIMER_DIVIDE_16     0x3
+
+/* time the APIC timer is measured against the PIT */
+#define LAPIC_CALIBRATE_US        10000
+
+static volatile uint32_t *lapic_base;
+
+/* set once on the boot processor, the other processors follow its lead */
+static bool lapic_x2apic;
+static bool lapic_tsc_deadline;
+
+/* timer rate, the same on all the processors */
+static uint64_t lapic_timer_ticks_per_ms;
+
+static inline uint32_t lapic_read(uint32_t reg)
+{
+    if (lapic_x2apic) {
+        return x86_read_msr(X2APIC_MSR(reg));
+    }
+    return lapic_base[reg / sizeof(uint32_t)];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val)
+{
+    if (lapic_x2apic) {
+        x86_write_msr(X2APIC_MSR(reg), val);
+    }
+    else {
+        lapic_base[reg / sizeof(uint32_t)] = val;
+    }
+}
 
 void apic_create_mapping(void)
 {
+    uint32_t eax, ebx, ecx, edx;
+    x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+
+    lapic_tsc_deadline = ecx & X86_CPUID_1_ECX_TSC_DL;
+
+    /* x2APIC registers are MSRs, there is nothing to map */
+    if (ecx & X86_CPUID_1_ECX_X2APIC) {
+        lapic_x2apic = true;
+        return;
+    }
+
+    paddr_t base = x86_read_msr(X86_IA32_MSR_APIC_BASE) & X86_4KB_PAGE_FRAME;
+
+    if (!base) {
+        base = APIC_PHY_BASE;
+    }
+
+    lapic_base = x86_mmu_map_mmio(base);
 }
 
 void lapic_init(void)
 {
+    uint64_t apic_base = x86_read_msr(X86_IA32_MSR_APIC_BASE);
+    uint64_t mode = X86_IA32_MSR_APIC_BASE_EN;
+
+    if (lapic_x2apic) {
+        mode |= X86_IA32_MSR_APIC_BASE_EXTD;
+    }
+
+    /* xAPIC has to be enabled before switching to x2APIC */
+    if ((apic_base & mode) != mode) {
+        apic_base |= X86_IA32_MSR_APIC_BASE_EN;
+        x86_write_msr(X86_IA32_MSR_APIC_BASE, apic_base);
+        x86_write_msr(X86_IA32_MSR_APIC_BASE, apic_base | mode);
+    }
+
+    /* accept all interrupts */
+    lapic_write(LAPIC_REG_TPR, 0);
+
+    /* software enable the APIC */
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+
+    /* the error status register has to be written before it's read */
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_write(LAPIC_REG_ESR, 0);
+
+    /* acknowledge anything left pending */
+    lapic_eoi();
+}
+
+bool lapic_is_x2apic(void)
+{
+    return lapic_x2apic;
+}
+
+uint32_t lapic_get_id(void)
+{
+    /* the x2APIC ID register holds the full 32-bit ID */
+    if (lapic_x2apic) {
+        return lapic_read(LAPIC_REG_ID);
+    }
+    return lapic_read(LAPIC_REG_ID) >> 24;
+}
+
+void lapic_eoi(void)
+{
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+static void lapic_send_ipi(uint32_t apic_id, uint32_t icr)
+{
+    /* the x2APIC ICR is a single MSR, the write sends the IPI without the
+     * delivery status to poll */
+    if (lapic_x2apic) {
+        x86_write_msr(X2APIC_MSR(LAPIC_REG_ICR_LO),
+                      ((uint64_t)apic_id << 32) | icr);
+        return;
+    }
+
+    lapic_write(LAPIC_REG_ICR_HI, apic_id << LAPIC_ICR_DEST_SHIFT);
+    lapic_write(LAPIC_REG_ICR_LO, icr);
+
+    /* wait until the IPI was accepted */
+    while (lapic_read(LAPIC_REG_ICR_LO) & LAPIC_ICR_DELIVERY_STATUS) {
+        x86_pause();
+    }
+}
+
+void lapic_send_ipi_fixed(uint32_t apic_id, uint8_t vector)
+{
+    lapic_send_ipi(apic_id, LAPIC_ICR_DM_FIXED | vector);
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+    lapic_write(LAPIC_REG_ESR, 0);
+
+    /* assert and de-assert INIT as described by the MP specification */
+    lapic_send_ipi(apic_id, LAPIC_ICR_DM_INIT | LAPIC_ICR_LEVEL_ASSERT |
+                                LAPIC_ICR_TRIGGER_LEVEL);
+    lapic_send_ipi(apic_id, LAPIC_ICR_DM_INIT | LAPIC_ICR_TRIGGER_LEVEL);
+}
+
+void lapic_send_startup(uint32_t apic_id, paddr_t entry)
+{
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_send_ipi(apic_id, LAPIC_ICR_DM_STARTUP | (entry >> X86_PT_SHIFT));
+}
+
+void lapic_broadcast_init(void)
+{
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_send_ipi(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_DM_INIT |
+                          LAPIC_ICR_LEVEL_ASSERT | LAPIC_ICR_TRIGGER_LEVEL);
+    lapic_send_ipi(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_DM_INIT |
+                          LAPIC_ICR_TRIGGER_LEVEL);
+}
+
+void lapic_broadcast_startup(paddr_t entry)
+{
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_send_ipi(0, LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_DM_STARTUP |
+                          (entry >> X86_PT_SHIFT));
+}
+
+/* measures the APIC timer against the PIT */
+static void lapic_timer_calibrate(void)
+{
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, UINT32_MAX);
+
+    pit_udelay(LAPIC_CALIBRATE_US);
+
+    uint32_t ticks = UINT32_MAX - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+
+    lapic_timer_ticks_per_ms = ticks / (LAPIC_CALIBRATE_US / 1000);
+}
+
+void lapic_timer_init(void)
+{
+    /* the TSC-deadline mode runs off the clock's TSC rate */
+    if (!lapic_tsc_deadline && !lapic_timer_ticks_per_ms) {
+        lapic_timer_calibrate();
+    }
+
+    /* the timer stays masked until it is armed */
+    if (lapic_tsc_deadline) {
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED |
+                                             LAPIC_LVT_TIMER_DEADLINE |
+                                             LAPIC_TIMER_VECTOR);
+    }
+    else {
+        lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_16);
+        lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED |
+                                             LAPIC_LVT_TIMER_ONESHOT |
+                                             LAPIC_TIMER_VECTOR);
+    }
+}
+
+void lapic_timer_arm(uint64_t ns)
+{
+    if (lapic_tsc_deadline) {
+        uint64_t deadline = x86_rdtsc() + clock_ns_to_tsc(ns);
+
+        lapic_write(LAPIC_REG_LVT_TIMER,
+                    LAPIC_LVT_TIMER_DEADLINE | LAPIC_TIMER_VECTOR);
+
+        /* order the LVT write before the deadline write */
+        __asm__ volatile("mfence" ::: "memory");
+        x86_write_msr(X86_IA32_MSR_TSC_DEADLINE, deadline);
+        return;
+    }
+
+    uint64_t count = ns / NSEC_PER_MSEC * lapic_timer_ticks_per_ms +
+                     ns % NSEC_PER_MSEC * lapic_timer_ticks_per_ms /
+                         NSEC_PER_MSEC;
+    if (count == 0) {
+        count = 1;
+    }
+    else if (count > UINT32_MAX) {
+        /* fire early, the caller re-arms for the remaining time */
+        count = UINT32_MAX;
+    }
+
+    lapic_write(LAPIC_REG_LVT_TIMER,
+                LAPIC_LVT_TIMER_ONESHOT | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_REG_TIMER_INITIAL, count);
+}
+
+void lapic_timer_cancel(void)
+{
+    if (lapic_tsc_deadline) {
+        x86_write_msr(X86_IA32_MSR_TSC_DEADLINE, 0);
+    }
+    else {
+        lapic_write(LAPIC_REG_TIMER_INITIAL, 0);
+    }
 }
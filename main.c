@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <x86.h>
 #include <thread.h>
+#include <cpu_data.h>
+#include <smp.h>
+#include <clock.h>
 
 extern void arch_init(void);
 extern void platform_init(void);
@@ -14,7 +17,10 @@ extern void vm_init_preheap(void);
 
 int __noreturn kmain(void)
 {
-    /* thread_init_early(); */
+    /* per-CPU data must be reachable through %gs before anything else */
+    boot_cpu_init();
+
+    thread_init_early();
     init_hooks_init();
 
     kernel_init_upto(INIT_STAGE_VM);
@@ -23,5 +29,13 @@ int __noreturn kmain(void)
 
     platform_init();
 
-    while (1) {}
+    /* the per-CPU timer and softirq state is set up against the clock */
+    clock_init();
+
+    kernel_init_upto(INIT_STAGE_PERCPU);
+
+    smp_init();
+
+    /* the boot thread becomes the idle thread of the boot processor */
+    thread_idle_loop();
 }
@@ -4,10 +4,20 @@
 #include <mmu.h>
 #include <pmm.h>
 #include <string.h>
+#include <tlb.h>
+#include <trace.h>
 
 uint8_t paddr_width = 32;
 uint8_t vaddr_width = 48;
 
+/* start.S */
+extern uint64_t boot_pml4_table[];
+extern uint64_t boot_pdp_table[];
+extern uint64_t boot_pde_array[];
+
+/* size of the linear mapping set up by start.S */
+#define BOOT_LINEAR_MAP_SIZE (64ULL * 1024 * 1024 * 1024)
+
 static uint32_t x86_cpuid_get_addr_width(void)
 {
     uint32_t eax, ebx, ecx, edx;
@@ -384,6 +394,99 @@ x86_mmu_status_t x86_mmu_query(vaddr_t vaddr, paddr_t *paddr, uint32_t *flags)
     return MMU_NO_ERROR;
 }
 
+void *x86_mmu_map_mmio(paddr_t paddr)
+{
+    if (paddr >= BOOT_LINEAR_MAP_SIZE) {
+        return NULL;
+    }
+
+    /* the linear mapping is made of 2 MiB pages */
+    uint64_t *pde = &boot_pde_array[paddr >> X86_PD_SHIFT];
+    if (!(*pde & X86_PAGE_BIT_PCD)) {
+        *pde |= X86_PAGE_BIT_PCD | X86_PAGE_BIT_PWT;
+        TRACEPOINT(mmu_map_mmio, "paddr %llx", paddr);
+
+        /* no CPU may keep using the cacheable translation */
+        tlb_flush_range(&kernel_aspace,
+                        X86_P2KV(ROUND_DOWN(paddr, 1UL << X86_PD_SHIFT)), 1);
+    }
+
+    return (void *)X86_P2KV(paddr);
+}
+
+/* kernel virtual address of the table a paging structure entry points to */
+static uint64_t *x86_entry_to_table(uint64_t entry)
+{
+    return (uint64_t *)X86_P2KV(entry & X86_4KB_PAGE_FRAME);
+}
+
+x86_mmu_status_t x86_mmu_unmap_addr(vaddr_t vaddr, addr_t pml4,
+                                    struct tlb_batch *batch)
+{
+    if (!x86_mmu_check_vaddr(vaddr)) {
+        return MMU_ERR_INVALID_ARGS;
+    }
+
+    uint64_t *entry = &((uint64_t *)pml4)[VADDR_TO_PML4_INDEX(vaddr)];
+    if (!(*entry & X86_PAGE_BIT_P)) {
+        return MMU_ERR_ENTRY_NOT_PRESENT;
+    }
+
+    entry = &x86_entry_to_table(*entry)[VADDR_TO_PDP_INDEX(vaddr)];
+    if (!(*entry & X86_PAGE_BIT_P)) {
+        return MMU_ERR_ENTRY_NOT_PRESENT;
+    }
+
+    /* 1 GiB pages are not split */
+    if (*entry & X86_PAGE_BIT_PS) {
+        return MMU_ERR_INVALID_ARGS;
+    }
+
+    entry = &x86_entry_to_table(*entry)[VADDR_TO_PD_INDEX(vaddr)];
+    if (!(*entry & X86_PAGE_BIT_P)) {
+        return MMU_ERR_ENTRY_NOT_PRESENT;
+    }
+
+    if (*entry & X86_PAGE_BIT_PS) {
+        if (!IS_ALIGNED(vaddr, 1UL << X86_PD_SHIFT)) {
+            return MMU_ERR_INVALID_ARGS;
+        }
+    }
+    else {
+        entry = &x86_entry_to_table(*entry)[VADDR_TO_PT_INDEX(vaddr)];
+        if (!(*entry & X86_PAGE_BIT_P)) {
+            return MMU_ERR_ENTRY_NOT_PRESENT;
+        }
+    }
+
+    *entry = 0;
+    TRACEPOINT(mmu_unmap, "vaddr %llx", vaddr);
+
+    /* one invlpg drops the translation of a large page as well */
+    if (batch) {
+        tlb_batch_add(batch, vaddr, 1);
+    }
+    else {
+        tlb_flush_range(&kernel_aspace, vaddr, 1);
+    }
+
+    return MMU_NO_ERROR;
+}
+
+void x86_mmu_map_low_identity(void)
+{
+    paddr_t pdp = (uintptr_t)boot_pdp_table - KERNEL_VMA_BASE;
+    boot_pml4_table[0] = pdp | X86_MMU_PG_FLAGS;
+}
+
+void x86_mmu_unmap_low_identity(void)
+{
+    boot_pml4_table[0] = 0;
+
+    /* flush TLB */
+    x86_set_cr3(x86_get_cr3());
+}
+
 void x86_mmu_init(void)
 {
     volatile uint64_t efer_msr, cr0, cr4;
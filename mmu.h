@@ -86,7 +86,39 @@ x86_mmu_status_t x86_mmu_check_mapping(vaddr_t vaddr, addr_t pml4,
 x86_mmu_status_t x86_mmu_map_addr(vaddr_t vaddr, addr_t pml4, paddr_t paddr,
                                   uint64_t mmu_flags);
 
+/**
+ * Returns a kernel virtual address through which the device registers at
+ * the given physical address can be accessed. The page of the linear
+ * mapping that covers the registers is made uncacheable.
+ *
+ * @param paddr Physical address of the device registers.
+ *
+ * @return Virtual address or NULL if the address is not mapped.
+ */
+void *x86_mmu_map_mmio(paddr_t paddr);
+
+/**
+ * Identity maps the lower 1 GiB of physical memory in the kernel page tables
+ * while the application processors come up through the real-mode
+ * trampoline.
+ */
+void x86_mmu_map_low_identity(void);
+void x86_mmu_unmap_low_identity(void);
+
+struct tlb_batch;
+
 /**
  * Remove the virtual to physical address mapping from mmu.
+ *
+ * @param vaddr Page aligned virtual address. A 2 MiB page is only removed as
+ * a whole, through its aligned base address.
+ *
+ * @param pml4 Base address of the PML4 table.
+ *
+ * @param batch Batch the stale translation is queued on, the caller flushes
+ * it once it is done with the page tables. With NULL the translation is
+ * invalidated on all the CPUs before returning, which is only valid for the
+ * kernel address space.
  */
-x86_mmu_status_t x8_mmu_unmap_addr(vaddr_t vaddr, addr_t pml4, paddr_t paddr);
+x86_mmu_status_t x86_mmu_unmap_addr(vaddr_t vaddr, addr_t pml4,
+                                    struct tlb_batch *batch);
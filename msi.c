@@ -0,0 +1,225 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <pci.h>
+#include <apic.h>
+#include <cpu_data.h>
+#include <mmu.h>
+#include <platform.h>
+
+/* MSI capability */
+#define PCI_MSI_FLAGS          0x02
+#define PCI_MSI_ADDRESS_LO     0x04
+#define PCI_MSI_ADDRESS_HI     0x08
+#define PCI_MSI_DATA_32        0x08
+#define PCI_MSI_DATA_64        0x0c
+
+#define PCI_MSI_FLAGS_ENABLE   (1 << 0)
+#define PCI_MSI_FLAGS_QMASK    0x000e /* Multiple message capable. */
+#define PCI_MSI_FLAGS_QSIZE    0x0070 /* Multiple message enable. */
+#define PCI_MSI_FLAGS_64BIT    (1 << 7)
+
+/* MSI-X capability */
+#define PCI_MSIX_FLAGS         0x02
+#define PCI_MSIX_TABLE         0x04
+
+#define PCI_MSIX_FLAGS_QSIZE   0x07ff /* Table size - 1. */
+#define PCI_MSIX_FLAGS_MASKALL (1 << 14)
+#define PCI_MSIX_FLAGS_ENABLE  (1 << 15)
+#define PCI_MSIX_TABLE_BIR     0x7
+
+/* MSI-X table entry, in dwords */
+#define PCI_MSIX_ENTRY_SIZE    4
+#define PCI_MSIX_ENTRY_ADDR_LO 0
+#define PCI_MSIX_ENTRY_ADDR_HI 1
+#define PCI_MSIX_ENTRY_DATA    2
+#define PCI_MSIX_ENTRY_CTRL    3
+
+#define PCI_MSIX_ENTRY_MASKED  (1 << 0)
+
+/* message address, physical destination mode */
+#define MSI_ADDR_BASE          0xfee00000
+#define MSI_ADDR_DEST_SHIFT    12
+
+/* without interrupt remapping the destination has 8 bits */
+static inline bool msi_reachable(uint32_t apic_id)
+{
+    return apic_id <= 0xff;
+}
+
+static inline uint32_t msi_address(uint32_t apic_id)
+{
+    return MSI_ADDR_BASE | apic_id << MSI_ADDR_DEST_SHIFT;
+}
+
+/* all the messages of an MSI block share the address, see
+ * irq_set_route_block() */
+static bool msi_route(uint32_t vector, uint32_t apic_id, void *data)
+{
+    pci_device_t *pdev = data;
+
+    if (!msi_reachable(apic_id)) {
+        return false;
+    }
+
+    pci_write32(pdev, pdev->msi_cap + PCI_MSI_ADDRESS_LO,
+                msi_address(apic_id));
+    return true;
+}
+
+int pci_enable_msi(pci_device_t *pdev, uint32_t count)
+{
+    if (!pdev->msi_cap || !count) {
+        return -1;
+    }
+
+    uint16_t ctrl = pci_read16(pdev, pdev->msi_cap + PCI_MSI_FLAGS);
+    uint32_t max = 1U << ((ctrl & PCI_MSI_FLAGS_QMASK) >> 1);
+
+    /* blocks are powers of two */
+    uint32_t log2 = 0;
+    while ((1U << log2) < count && (1U << log2) < max) {
+        log2++;
+    }
+    count = 1U << log2;
+
+    int vector = irq_alloc_vectors(count);
+    if (vector < 0) {
+        return -1;
+    }
+
+    uint8_t data_reg = PCI_MSI_DATA_32;
+    if (ctrl & PCI_MSI_FLAGS_64BIT) {
+        pci_write32(pdev, pdev->msi_cap + PCI_MSI_ADDRESS_HI, 0);
+        data_reg = PCI_MSI_DATA_64;
+    }
+
+    /* edge triggered, fixed delivery, the function ORs in the message
+     * number */
+    pci_write16(pdev, pdev->msi_cap + data_reg, vector);
+
+    /* a single address register, the messages move together */
+    irq_set_route_block(vector, count, msi_route, pdev);
+
+    ctrl &= ~PCI_MSI_FLAGS_QSIZE;
+    ctrl |= log2 << 4 | PCI_MSI_FLAGS_ENABLE;
+    pci_write16(pdev, pdev->msi_cap + PCI_MSI_FLAGS, ctrl);
+
+    /* messages are memory writes from the device, no more legacy
+     * interrupts */
+    pci_write16(pdev, PCI_COMMAND,
+                pci_read16(pdev, PCI_COMMAND) | PCI_COMMAND_MASTER |
+                    PCI_COMMAND_INTX_OFF);
+
+    return vector;
+}
+
+static volatile uint32_t *msix_entry(pci_device_t *pdev, uint32_t entry)
+{
+    return &pdev->msix_table[entry * PCI_MSIX_ENTRY_SIZE];
+}
+
+/* masks the entry while the address changes, the device holds back the
+ * message meanwhile */
+static bool msix_route(uint32_t vector, uint32_t apic_id, void *data)
+{
+    volatile uint32_t *ent = data;
+
+    if (!msi_reachable(apic_id)) {
+        return false;
+    }
+
+    uint32_t ctrl = ent[PCI_MSIX_ENTRY_CTRL];
+    ent[PCI_MSIX_ENTRY_CTRL] = ctrl | PCI_MSIX_ENTRY_MASKED;
+    ent[PCI_MSIX_ENTRY_ADDR_LO] = msi_address(apic_id);
+    ent[PCI_MSIX_ENTRY_ADDR_HI] = 0;
+    ent[PCI_MSIX_ENTRY_CTRL] = ctrl;
+
+    return true;
+}
+
+uint32_t pci_enable_msix(pci_device_t *pdev, uint32_t count,
+                         const uint32_t *cpus, uint8_t *vectors)
+{
+    if (!pdev->msix_cap) {
+        return 0;
+    }
+
+    uint16_t ctrl = pci_read16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS);
+    uint32_t table = pci_read32(pdev, pdev->msix_cap + PCI_MSIX_TABLE);
+    uint64_t bar = pci_bar_address(pdev, table & PCI_MSIX_TABLE_BIR);
+
+    if (!bar) {
+        return 0;
+    }
+
+    pdev->msix_table =
+        x86_mmu_map_mmio(bar + (table & ~PCI_MSIX_TABLE_BIR));
+    if (!pdev->msix_table) {
+        return 0;
+    }
+    pdev->msix_count = (ctrl & PCI_MSIX_FLAGS_QSIZE) + 1;
+
+    if (count > pdev->msix_count) {
+        count = pdev->msix_count;
+    }
+
+    /* keep the function quiet while the table is filled in */
+    uint16_t cmd = pci_read16(pdev, PCI_COMMAND);
+
+    ctrl |= PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL;
+    pci_write16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS, ctrl);
+    pci_write16(pdev, PCI_COMMAND,
+                cmd | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER |
+                    PCI_COMMAND_INTX_OFF);
+
+    uint32_t done;
+    for (done = 0; done < count; ++done) {
+        if (cpus && cpus[done] >= MAX_NCPUS) {
+            break;
+        }
+
+        int vector = irq_alloc_vectors(1);
+        if (vector < 0) {
+            break;
+        }
+
+        volatile uint32_t *ent = msix_entry(pdev, done);
+        ent[PCI_MSIX_ENTRY_CTRL] = PCI_MSIX_ENTRY_MASKED;
+        ent[PCI_MSIX_ENTRY_DATA] = vector;
+
+        irq_set_route(vector, msix_route, (void *)ent);
+
+        /* the entry stays masked if its CPU cannot be reached */
+        if (cpus && !irq_set_affinity(vector, CPU_MASK(cpus[done]))) {
+            irq_free_vectors(vector, 1);
+            break;
+        }
+
+        ent[PCI_MSIX_ENTRY_CTRL] = 0;
+        vectors[done] = vector;
+    }
+
+    /* nothing set up, leave the function as the caller found it so that
+     * it can fall back to MSI or INTx */
+    if (!done) {
+        ctrl &= ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+        pci_write16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS, ctrl);
+        pci_write16(pdev, PCI_COMMAND, cmd);
+        return 0;
+    }
+
+    ctrl &= ~PCI_MSIX_FLAGS_MASKALL;
+    pci_write16(pdev, pdev->msix_cap + PCI_MSIX_FLAGS, ctrl);
+
+    return done;
+}
+
+void pci_msix_mask(pci_device_t *pdev, uint32_t entry)
+{
+    msix_entry(pdev, entry)[PCI_MSIX_ENTRY_CTRL] |= PCI_MSIX_ENTRY_MASKED;
+}
+
+void pci_msix_unmask(pci_device_t *pdev, uint32_t entry)
+{
+    msix_entry(pdev, entry)[PCI_MSIX_ENTRY_CTRL] &= ~PCI_MSIX_ENTRY_MASKED;
+}
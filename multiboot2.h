@@ -30,6 +30,13 @@ typedef struct multiboot2_tag_mmap {
     multiboot2_mmap_entry_t entries[];
 } multiboot2_tag_mmap_t;
 
+/* copy of the RSDP, version 1 in the old and version 2 in the new tag */
+typedef struct multiboot2_tag_acpi {
+    uint32_t type;
+    uint32_t size;
+    uint8_t  rsdp[];
+} multiboot2_tag_acpi_t;
+
 enum multiboot2_mmap_memory_status {
     MULTIBOOT2_MMAP_MEMORY_AVAILABLE = 1,
     MULTIBOOT2_MMAP_MEMORY_RESERVED,
@@ -41,4 +48,6 @@ enum multiboot2_mmap_memory_status {
 enum multiboot2_tag_type {
     MULTIBOOT2_TAG_TYPE_END = 0,
     MULTIBOOT2_TAG_TYPE_MMAP = 6,
+    MULTIBOOT2_TAG_TYPE_ACPI_OLD = 14,
+    MULTIBOOT2_TAG_TYPE_ACPI_NEW = 15,
 };
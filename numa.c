@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <numa.h>
+#include <percpu.h>
+
+uint32_t numa_node_count = 1;
+
+/* proximity domain of each node */
+static uint32_t numa_domains[MAX_NUMNODES];
+static uint32_t numa_domain_count;
+
+static numa_memblock_t numa_memblocks[MAX_NUMA_MEMBLOCKS];
+static uint32_t        numa_memblock_count;
+
+static uint8_t numa_distances[MAX_NUMNODES][MAX_NUMNODES];
+
+/* nodes of each node sorted by distance */
+static uint8_t numa_fallback[MAX_NUMNODES][MAX_NUMNODES];
+
+static struct {
+    uint32_t apic_id;
+    uint32_t node;
+} numa_cpus[MAX_NCPUS];
+static uint32_t numa_cpu_count;
+
+uint32_t numa_domain_to_node(uint32_t domain)
+{
+    for (uint32_t node = 0; node < numa_domain_count; ++node) {
+        if (numa_domains[node] == domain) {
+            return node;
+        }
+    }
+
+    /* fold the domains we have no room for into the last node */
+    if (numa_domain_count == MAX_NUMNODES) {
+        return MAX_NUMNODES - 1;
+    }
+
+    numa_domains[numa_domain_count] = domain;
+    numa_node_count = ++numa_domain_count;
+    return numa_domain_count - 1;
+}
+
+void numa_add_cpu(uint32_t apic_id, uint32_t node)
+{
+    if (numa_cpu_count < MAX_NCPUS) {
+        numa_cpus[numa_cpu_count].apic_id = apic_id;
+        numa_cpus[numa_cpu_count].node = node;
+        numa_cpu_count++;
+    }
+}
+
+void numa_add_memblock(paddr_t base, size_t size, uint32_t node)
+{
+    if (numa_memblock_count < MAX_NUMA_MEMBLOCKS) {
+        numa_memblocks[numa_memblock_count++] = (numa_memblock_t){
+            .base = base,
+            .size = size,
+            .node = node,
+        };
+    }
+}
+
+uint32_t numa_cpu_to_node(uint32_t apic_id)
+{
+    for (uint32_t i = 0; i < numa_cpu_count; ++i) {
+        if (numa_cpus[i].apic_id == apic_id) {
+            return numa_cpus[i].node;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t numa_addr_to_node(paddr_t addr, paddr_t *end)
+{
+    paddr_t next = (paddr_t)-1;
+
+    for (uint32_t i = 0; i < numa_memblock_count; ++i) {
+        numa_memblock_t *mb = &numa_memblocks[i];
+
+        if (addr >= mb->base && addr - mb->base < mb->size) {
+            *end = mb->base + mb->size;
+            return mb->node;
+        }
+
+        /* remember where the next described block starts */
+        if (mb->base > addr && mb->base < next) {
+            next = mb->base;
+        }
+    }
+
+    *end = next;
+    return 0;
+}
+
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance)
+{
+    if (from < MAX_NUMNODES && to < MAX_NUMNODES) {
+        numa_distances[from][to] = distance;
+    }
+}
+
+uint8_t numa_distance(uint32_t from, uint32_t to)
+{
+    /* without a SLIT every remote node is equally far away */
+    if (!numa_distances[from][to]) {
+        return from == to ? NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+    }
+
+    return numa_distances[from][to];
+}
+
+void numa_build_fallback_order(void)
+{
+    for (uint32_t node = 0; node < numa_node_count; ++node) {
+        uint8_t *order = numa_fallback[node];
+        uint32_t count = 1;
+
+        /* the node itself comes first, insertion sort the others */
+        order[0] = node;
+        for (uint32_t other = 0; other < numa_node_count; ++other) {
+            if (other == node) {
+                continue;
+            }
+
+            uint32_t j = count++;
+            while (j > 1 && numa_distance(node, order[j - 1]) >
+                                numa_distance(node, other)) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = other;
+        }
+    }
+}
+
+uint32_t numa_fallback_node(uint32_t node, uint32_t idx)
+{
+    return numa_fallback[node][idx];
+}
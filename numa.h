@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <types.h>
+
+#define MAX_NUMNODES       8
+#define MAX_NUMA_MEMBLOCKS 32
+
+/* SLIT distances, a node's distance to itself is always 10 */
+#define NUMA_LOCAL_DISTANCE  10
+#define NUMA_REMOTE_DISTANCE 20
+
+/**
+ * Memory range with a known node, filled in from the firmware tables.
+ */
+typedef struct numa_memblock {
+    paddr_t  base;
+    size_t   size;
+    uint32_t node;
+} numa_memblock_t;
+
+/**
+ * Number of nodes, 1 if the firmware does not describe the topology.
+ */
+extern uint32_t numa_node_count;
+
+/**
+ * Maps a firmware proximity domain to a dense node id, allocating a new
+ * node the first time the domain is seen.
+ *
+ * @param domain Proximity domain.
+ *
+ * @return Node id.
+ */
+uint32_t numa_domain_to_node(uint32_t domain);
+
+/**
+ * Records the node of a processor.
+ */
+void numa_add_cpu(uint32_t apic_id, uint32_t node);
+
+/**
+ * Records the node of a memory range.
+ */
+void numa_add_memblock(paddr_t base, size_t size, uint32_t node);
+
+/**
+ * Returns the node of a processor, 0 if it is not known.
+ */
+uint32_t numa_cpu_to_node(uint32_t apic_id);
+
+/**
+ * Returns the node the physical address belongs to.
+ *
+ * @param addr Physical address.
+ *
+ * @param end End of the range sharing the node of addr, i.e. the end of the
+ * memory block or the start of the next block if addr is not covered.
+ *
+ * @return Node id, 0 for memory not described by the firmware.
+ */
+uint32_t numa_addr_to_node(paddr_t addr, paddr_t /* out */ *end);
+
+/**
+ * Records the relative distance between two nodes.
+ */
+void numa_set_distance(uint32_t from, uint32_t to, uint8_t distance);
+
+/**
+ * Returns the relative distance between two nodes.
+ */
+uint8_t numa_distance(uint32_t from, uint32_t to);
+
+/**
+ * Sorts the nodes by their distance from each node. Must be called once
+ * the topology is known.
+ */
+void numa_build_fallback_order(void);
+
+/**
+ * Returns the nodes in the order allocations for a node should try them.
+ *
+ * @param node Preferred node.
+ *
+ * @param idx Position in the order, 0 is the node itself.
+ *
+ * @return Node id.
+ */
+uint32_t numa_fallback_node(uint32_t node, uint32_t idx);
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <pci.h>
+#include <spinlock.h>
+#include <x86.h>
+
+/* configuration mechanism #1 */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA    0xcfc
+#define PCI_CONFIG_ENABLE  0x80000000
+
+#define PCI_BAR_IO         (1 << 0)
+#define PCI_BAR_TYPE_MASK  0x6
+#define PCI_BAR_TYPE_64    0x4
+#define PCI_BAR_MEM_MASK   (~0xfULL)
+
+/* the address and data ports form one register pair for all the CPUs */
+static spin_lock_t pci_config_lock;
+
+static uint32_t pci_config_address(const pci_device_t *pdev, uint8_t reg)
+{
+    return PCI_CONFIG_ENABLE | (uint32_t)pdev->bus << 16 |
+           (uint32_t)pdev->dev << 11 | (uint32_t)pdev->func << 8 |
+           (reg & 0xfc);
+}
+
+uint32_t pci_read32(const pci_device_t *pdev, uint8_t reg)
+{
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pci_config_lock, &flags);
+
+    x86_outp32(PCI_CONFIG_ADDRESS, pci_config_address(pdev, reg));
+    uint32_t val = x86_inp32(PCI_CONFIG_DATA);
+
+    spin_lock_unlock_irqrestore(&pci_config_lock, flags);
+    return val;
+}
+
+uint16_t pci_read16(const pci_device_t *pdev, uint8_t reg)
+{
+    return pci_read32(pdev, reg) >> ((reg & 2) * 8);
+}
+
+uint8_t pci_read8(const pci_device_t *pdev, uint8_t reg)
+{
+    return pci_read32(pdev, reg) >> ((reg & 3) * 8);
+}
+
+void pci_write32(const pci_device_t *pdev, uint8_t reg, uint32_t val)
+{
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pci_config_lock, &flags);
+
+    x86_outp32(PCI_CONFIG_ADDRESS, pci_config_address(pdev, reg));
+    x86_outp32(PCI_CONFIG_DATA, val);
+
+    spin_lock_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+void pci_write16(const pci_device_t *pdev, uint8_t reg, uint16_t val)
+{
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pci_config_lock, &flags);
+
+    x86_outp32(PCI_CONFIG_ADDRESS, pci_config_address(pdev, reg));
+    x86_outp16(PCI_CONFIG_DATA + (reg & 2), val);
+
+    spin_lock_unlock_irqrestore(&pci_config_lock, flags);
+}
+
+bool pci_find_device(uint16_t vendor, uint16_t device, uint32_t index,
+                     pci_device_t *pdev)
+{
+    for (uint32_t bus = 0; bus < 256; ++bus) {
+        for (uint32_t dev = 0; dev < 32; ++dev) {
+            for (uint32_t func = 0; func < 8; ++func) {
+                pci_device_t probe = {
+                    .bus = bus,
+                    .dev = dev,
+                    .func = func,
+                };
+
+                uint32_t id = pci_read32(&probe, PCI_VENDOR_ID);
+                if ((id & 0xffff) == 0xffff) {
+                    /* no function 0, no device */
+                    if (!func) {
+                        break;
+                    }
+                    continue;
+                }
+
+                if ((id & 0xffff) == vendor && id >> 16 == device &&
+                    !index--) {
+                    *pdev = probe;
+                    pdev->vendor = vendor;
+                    pdev->device = device;
+                    pdev->msi_cap = pci_find_capability(pdev, PCI_CAP_ID_MSI);
+                    pdev->msix_cap =
+                        pci_find_capability(pdev, PCI_CAP_ID_MSIX);
+                    return true;
+                }
+
+                /* single function device */
+                if (!func && !(pci_read8(&probe, PCI_HEADER_TYPE) & 0x80)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+uint8_t pci_find_capability(const pci_device_t *pdev, uint8_t id)
+{
+    if (!(pci_read16(pdev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+
+    /* bounded in case of a looping list */
+    uint8_t pos = pci_read8(pdev, PCI_CAPABILITY_LIST) & 0xfc;
+    for (uint32_t i = 0; pos && i < 48; ++i) {
+        uint16_t cap = pci_read16(pdev, pos);
+
+        if ((cap & 0xff) == id) {
+            return pos;
+        }
+        pos = (cap >> 8) & 0xfc;
+    }
+
+    return 0;
+}
+
+uint64_t pci_bar_address(const pci_device_t *pdev, uint32_t bar)
+{
+    uint8_t  reg = PCI_BAR0 + bar * 4;
+    uint64_t val = pci_read32(pdev, reg);
+
+    if (val & PCI_BAR_IO) {
+        return 0;
+    }
+
+    if ((val & PCI_BAR_TYPE_MASK) == PCI_BAR_TYPE_64 &&
+        bar + 1 < PCI_NUM_BARS) {
+        val |= (uint64_t)pci_read32(pdev, reg + 4) << 32;
+    }
+
+    return val & PCI_BAR_MEM_MASK;
+}
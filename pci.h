@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Configuration space header */
+#define PCI_VENDOR_ID         0x00
+#define PCI_DEVICE_ID         0x02
+#define PCI_COMMAND           0x04
+#define PCI_STATUS            0x06
+#define PCI_HEADER_TYPE       0x0e
+#define PCI_BAR0              0x10
+#define PCI_CAPABILITY_LIST   0x34
+
+#define PCI_COMMAND_MEMORY    (1 << 1)
+#define PCI_COMMAND_MASTER    (1 << 2)
+#define PCI_COMMAND_INTX_OFF  (1 << 10)
+
+#define PCI_STATUS_CAP_LIST   (1 << 4)
+
+/* Capability IDs */
+#define PCI_CAP_ID_MSI        0x05
+#define PCI_CAP_ID_MSIX       0x11
+
+#define PCI_NUM_BARS          6
+
+typedef struct pci_device {
+    uint8_t  bus;
+    uint8_t  dev;
+    uint8_t  func;
+    uint16_t vendor;
+    uint16_t device;
+
+    uint8_t            msi_cap;    /* Offset of the capability, 0 if none. */
+    uint8_t            msix_cap;
+    uint16_t           msix_count; /* MSI-X table entries. */
+    volatile uint32_t *msix_table; /* Mapped MSI-X table. */
+} pci_device_t;
+
+uint32_t pci_read32(const pci_device_t *pdev, uint8_t reg);
+uint16_t pci_read16(const pci_device_t *pdev, uint8_t reg);
+uint8_t  pci_read8(const pci_device_t *pdev, uint8_t reg);
+void     pci_write32(const pci_device_t *pdev, uint8_t reg, uint32_t val);
+void     pci_write16(const pci_device_t *pdev, uint8_t reg, uint16_t val);
+
+/**
+ * Scans the configuration space through the legacy 0xcf8/0xcfc ports.
+ *
+ * @param vendor Vendor ID.
+ *
+ * @param device Device ID.
+ *
+ * @param index Skips the first index matching functions.
+ *
+ * @param pdev Filled in with the function found.
+ *
+ * @return false if there is no such function.
+ */
+bool pci_find_device(uint16_t vendor, uint16_t device, uint32_t index,
+                     pci_device_t *pdev);
+
+/**
+ * Offset of a capability in the configuration space.
+ *
+ * @return 0 if the function does not have the capability.
+ */
+uint8_t pci_find_capability(const pci_device_t *pdev, uint8_t id);
+
+/**
+ * Physical address of a memory BAR.
+ *
+ * @return 0 for an I/O BAR.
+ */
+uint64_t pci_bar_address(const pci_device_t *pdev, uint32_t bar);
+
+/**
+ * Switches the function to MSI with vectors allocated from the interrupt
+ * table. A multiple message block shares a single destination CPU and is
+ * routed as a unit through its first vector, use MSI-X to spread
+ * interrupts over CPUs.
+ *
+ * @param count Vectors wanted, rounded up to a power of two and capped at
+ * what the function supports.
+ *
+ * @return First vector of the block, or -1 on failure. The handlers are
+ * installed with register_isr().
+ */
+int pci_enable_msi(pci_device_t *pdev, uint32_t count);
+
+/**
+ * Switches the function to MSI-X, one vector per table entry, entry i
+ * targeted at cpus[i] (irq_default_affinity if cpus is NULL). Stops at the
+ * first entry whose CPU cannot be targeted. The entries start unmasked.
+ * The pci_device_t must stay around as long as the vectors are in use.
+ *
+ * @param count Entries to set up.
+ *
+ * @param cpus Target CPU of each entry, or NULL.
+ *
+ * @param vectors Receives the vector of each entry.
+ *
+ * @return Entries set up. 0 on failure, the function is then left in the
+ * state it was found in.
+ */
+uint32_t pci_enable_msix(pci_device_t *pdev, uint32_t count,
+                         const uint32_t *cpus, uint8_t *vectors);
+
+/**
+ * Masks an MSI-X table entry.
+ */
+void pci_msix_mask(pci_device_t *pdev, uint32_t entry);
+
+/**
+ * Unmasks an MSI-X table entry.
+ */
+void pci_msix_unmask(pci_device_t *pdev, uint32_t entry);
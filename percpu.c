@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <percpu.h>
+#include <balloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86.h>
+
+/* per-CPU areas are cache line aligned so no two CPUs share a line */
+#define PERCPU_AREA_ALIGN 64
+
+uintptr_t percpu_offset[MAX_NCPUS];
+
+DEFINE_PER_CPU(uintptr_t, this_cpu_off);
+
+void percpu_setup_area(uint32_t cpu)
+{
+    size_t size = (uintptr_t)__percpu_end - (uintptr_t)__percpu_start;
+
+    uintptr_t area = (uintptr_t)balloc(size + PERCPU_AREA_ALIGN);
+    area = ROUND_UP(area, PERCPU_AREA_ALIGN);
+
+    /* copy the template into the new area */
+    memcpy((void *)area, __percpu_load, size);
+
+    percpu_offset[cpu] = area - (uintptr_t)__percpu_start;
+    per_cpu(this_cpu_off, cpu) = percpu_offset[cpu];
+}
+
+void percpu_load(uint32_t cpu)
+{
+    x86_write_msr(X86_IA32_MSR_GS_BASE, percpu_offset[cpu]);
+}
@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <compiler.h>
+
+#define MAX_NCPUS 64
+
+/**
+ * Per-CPU variables live in the ".percpu" section which is linked at address
+ * zero (see kernel.lds.S). At boot every CPU receives its own copy of this
+ * section and points its GS base at it. The link address of a per-CPU
+ * variable is therefore its offset inside the per-CPU area, which lets the
+ * this_cpu_*() accessors compile to a single %gs-relative instruction.
+ *
+ * Per-CPU variables must only be accessed through the accessors below.
+ */
+#define __PER_CPU_NAME(name) percpu__##name
+#define PER_CPU_NAME(name)   __PER_CPU_NAME(name)
+
+#define DECLARE_PER_CPU(type, name)                                            \
+    extern __typeof__(type) PER_CPU_NAME(name)
+
+#define DEFINE_PER_CPU(type, name)                                             \
+    __section(".percpu") __typeof__(type) PER_CPU_NAME(name)
+
+/**
+ * Only used by cpu_data, which must sit at offset zero of the per-CPU area.
+ */
+#define DEFINE_PER_CPU_FIRST(type, name)                                       \
+    __section(".percpu.first") __typeof__(type) PER_CPU_NAME(name)
+
+/* kernel.lds.S */
+extern uint8_t __percpu_start[];
+extern uint8_t __percpu_end[];
+extern uint8_t __percpu_load[];
+
+/**
+ * Offset of each CPU's per-CPU area from the link address of the template.
+ */
+extern uintptr_t percpu_offset[MAX_NCPUS];
+
+DECLARE_PER_CPU(uintptr_t, this_cpu_off);
+
+/**
+ * Pointer to the specified CPU's instance of a per-CPU variable.
+ */
+#define per_cpu_ptr(name, cpu)                                                 \
+    ((__typeof__(&PER_CPU_NAME(name)))(percpu_offset[cpu] +                    \
+                                       (uintptr_t)&PER_CPU_NAME(name)))
+
+#define per_cpu(name, cpu) (*per_cpu_ptr(name, cpu))
+
+/*
+ * Single instruction %gs-relative operations. Only scalar types of 1, 2, 4
+ * or 8 bytes are supported.
+ */
+
+#define this_cpu_read(name)                                                    \
+    ({                                                                         \
+        unsigned long __val;                                                   \
+        switch (sizeof(PER_CPU_NAME(name))) {                                  \
+        case 1:                                                                \
+            __asm__ volatile("movzbq %%gs:%P1, %0"                             \
+                             : "=r"(__val)                                     \
+                             : "i"(&PER_CPU_NAME(name)));                      \
+            break;                                                             \
+        case 2:                                                                \
+            __asm__ volatile("movzwq %%gs:%P1, %0"                             \
+                             : "=r"(__val)                                     \
+                             : "i"(&PER_CPU_NAME(name)));                      \
+            break;                                                             \
+        case 4:                                                                \
+            __asm__ volatile("movl %%gs:%P1, %k0"                              \
+                             : "=r"(__val)                                     \
+                             : "i"(&PER_CPU_NAME(name)));                      \
+            break;                                                             \
+        default:                                                               \
+            __asm__ volatile("movq %%gs:%P1, %0"                               \
+                             : "=r"(__val)                                     \
+                             : "i"(&PER_CPU_NAME(name)));                      \
+            break;                                                             \
+        }                                                                      \
+        (__typeof__(PER_CPU_NAME(name)))__val;                                 \
+    })
+
+#define __this_cpu_to_op(op, name, val)                                        \
+    do {                                                                       \
+        unsigned long __val = (unsigned long)(val);                            \
+        switch (sizeof(PER_CPU_NAME(name))) {                                  \
+        case 1:                                                                \
+            __asm__ volatile(op "b %b1, %%gs:%P0"                              \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val)            \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        case 2:                                                                \
+            __asm__ volatile(op "w %w1, %%gs:%P0"                              \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val)            \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        case 4:                                                                \
+            __asm__ volatile(op "l %k1, %%gs:%P0"                              \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val)            \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        default:                                                               \
+            __asm__ volatile(op "q %1, %%gs:%P0"                               \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val)            \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        }                                                                      \
+    } while (0)
+
+/*
+ * Same as above for an element of a per-CPU array.
+ */
+#define __this_cpu_idx_to_op(op, name, idx, val)                               \
+    do {                                                                       \
+        unsigned long __val = (unsigned long)(val);                            \
+        unsigned long __idx = (unsigned long)(idx);                            \
+        switch (sizeof(PER_CPU_NAME(name)[0])) {                               \
+        case 1:                                                                \
+            __asm__ volatile(op "b %b1, %%gs:%P0(,%2,1)"                       \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val),           \
+                               "r"(__idx)                                      \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        case 2:                                                                \
+            __asm__ volatile(op "w %w1, %%gs:%P0(,%2,2)"                       \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val),           \
+                               "r"(__idx)                                      \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        case 4:                                                                \
+            __asm__ volatile(op "l %k1, %%gs:%P0(,%2,4)"                       \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val),           \
+                               "r"(__idx)                                      \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        default:                                                               \
+            __asm__ volatile(op "q %1, %%gs:%P0(,%2,8)"                        \
+                             :                                                 \
+                             : "i"(&PER_CPU_NAME(name)), "r"(__val),           \
+                               "r"(__idx)                                      \
+                             : "memory", "cc");                                \
+            break;                                                             \
+        }                                                                      \
+    } while (0)
+
+#define this_cpu_write(name, val) __this_cpu_to_op("mov", name, val)
+#define this_cpu_add(name, val)   __this_cpu_to_op("add", name, val)
+#define this_cpu_sub(name, val)   __this_cpu_to_op("sub", name, val)
+#define this_cpu_inc(name)        this_cpu_add(name, 1)
+#define this_cpu_dec(name)        this_cpu_sub(name, 1)
+
+/**
+ * Adds to a 64-bit per-CPU variable and returns its previous value. A
+ * single xadd, atomic with respect to interrupts on the same CPU only.
+ */
+#define this_cpu_fetch_add(name, val)                                          \
+    ({                                                                         \
+        unsigned long __val = (unsigned long)(val);                            \
+        _Static_assert(sizeof(PER_CPU_NAME(name)) == 8, "64-bit only");        \
+        __asm__ volatile("xaddq %0, %%gs:%P1"                                  \
+                         : "+r"(__val)                                         \
+                         : "i"(&PER_CPU_NAME(name))                            \
+                         : "memory", "cc");                                    \
+        (__typeof__(PER_CPU_NAME(name)))__val;                                 \
+    })
+
+#define this_cpu_add_idx(name, idx, val)                                       \
+    __this_cpu_idx_to_op("add", name, idx, val)
+#define this_cpu_inc_idx(name, idx) this_cpu_add_idx(name, idx, 1)
+
+/**
+ * Pointer to the current CPU's instance of a per-CPU variable. The pointer
+ * is only meaningful as long as the caller cannot migrate to another CPU.
+ */
+#define this_cpu_ptr(name)                                                     \
+    ((__typeof__(&PER_CPU_NAME(name)))(this_cpu_read(this_cpu_off) +           \
+                                       (uintptr_t)&PER_CPU_NAME(name)))
+
+/**
+ * Iterate over every CPU that has a per-CPU area.
+ */
+#define for_each_possible_cpu(cpu)                                             \
+    for ((cpu) = 0; (cpu) < MAX_NCPUS; (cpu)++)                                \
+        if (percpu_offset[cpu])
+
+/**
+ * Allocates the per-CPU area for the specified CPU and initializes it
+ * from the per-CPU template.
+ *
+ * @param cpu CPU number.
+ */
+void percpu_setup_area(uint32_t cpu);
+
+/**
+ * Points the GS base of the calling CPU at the per-CPU area of the
+ * specified CPU.
+ *
+ * @param cpu CPU number of the caller.
+ */
+void percpu_load(uint32_t cpu);
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <pic.h>
 #include <stdint.h>
 #include <x86.h>
 
@@ -14,16 +15,55 @@
 
 #define PIC_EOI      0x20       /* PIC End-of-Interrupt command code */
 
+#define ICW1_ICW4    0x01       /* ICW4 will be present */
+#define ICW1_INIT    0x10       /* Initialization */
+#define ICW4_8086    0x01       /* 8086/88 mode */
+
+/* write to an unused port to give the PIC time to settle */
+static inline void pic_io_wait(void)
+{
+    x86_outp8(0x80, 0);
+}
+
 /**
  * Remaps the PIC controllers, giving them the specified vector
  * offsets, overriding the default configurations.
  */
 static void pic_remap(uint32_t offset1, uint32_t offset2)
 {
+    /* start the initialization sequence */
+    x86_outp8(PIC1_COMMAND, ICW1_INIT | ICW1_ICW4);
+    pic_io_wait();
+    x86_outp8(PIC2_COMMAND, ICW1_INIT | ICW1_ICW4);
+    pic_io_wait();
+
+    /* vector offsets */
+    x86_outp8(PIC1_DATA, offset1);
+    pic_io_wait();
+    x86_outp8(PIC2_DATA, offset2);
+    pic_io_wait();
+
+    /* the slave is cascaded on IRQ 2 of the master */
+    x86_outp8(PIC1_DATA, 1 << 2);
+    pic_io_wait();
+    x86_outp8(PIC2_DATA, 2);
+    pic_io_wait();
+
+    x86_outp8(PIC1_DATA, ICW4_8086);
+    pic_io_wait();
+    x86_outp8(PIC2_DATA, ICW4_8086);
+    pic_io_wait();
 }
 
 void pic_init(void)
 {
+    /* spurious interrupts still raised by a masked PIC must not look like
+     * exceptions */
+    pic_remap(PIC1_VECTOR_OFFSET, PIC2_VECTOR_OFFSET);
+
+    /* mask everything */
+    x86_outp8(PIC1_DATA, 0xff);
+    x86_outp8(PIC2_DATA, 0xff);
 }
 
 void pic_send_eoi(uint8_t irq)
@@ -32,7 +72,7 @@ void pic_send_eoi(uint8_t irq)
 
     /* if the irq came from slave then we need to send eoi
      * to both slave and the master chips */
-    if (irq > 8) {
+    if (irq >= 8) {
         x86_outp8(PIC2_COMMAND, PIC_EOI);
     }
 }
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+
+#define PIC1_VECTOR_OFFSET 0x20
+#define PIC2_VECTOR_OFFSET 0x28
+
+/**
+ * Moves the legacy 8259 interrupts out of the exception vectors and masks
+ * all of them. Interrupts are delivered through the APICs instead.
+ */
+void pic_init(void);
+
+void pic_send_eoi(uint8_t irq);
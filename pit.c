@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <pit.h>
+#include <x86.h>
+
+#define PIT_CH2_DATA      0x42
+#define PIT_COMMAND       0x43
+#define PIT_CH2_GATE      0x61
+
+#define PIT_GATE_ENABLE   0x01 /* Channel 2 gate */
+#define PIT_GATE_SPEAKER  0x02 /* Speaker data enable */
+#define PIT_GATE_OUT      0x20 /* Channel 2 output */
+
+/* channel 2, lobyte/hibyte access, mode 0 (interrupt on terminal count) */
+#define PIT_CMD_CH2_MODE0 0xb0
+
+/* the counter is 16 bits wide, wait in chunks that fit into it */
+#define PIT_MAX_CHUNK_US  50000
+
+static void pit_wait_ticks(uint16_t ticks)
+{
+    uint8_t gate = x86_inp8(PIT_CH2_GATE);
+
+    /* keep the speaker quiet and enable the channel 2 gate */
+    x86_outp8(PIT_CH2_GATE, (gate & ~PIT_GATE_SPEAKER) | PIT_GATE_ENABLE);
+
+    x86_outp8(PIT_COMMAND, PIT_CMD_CH2_MODE0);
+    x86_outp8(PIT_CH2_DATA, ticks & 0xff);
+    x86_outp8(PIT_CH2_DATA, ticks >> 8);
+
+    /* the output goes high once the counter reaches zero */
+    while (!(x86_inp8(PIT_CH2_GATE) & PIT_GATE_OUT)) {
+        x86_pause();
+    }
+}
+
+void pit_udelay(uint32_t us)
+{
+    while (us > 0) {
+        uint32_t chunk = us < PIT_MAX_CHUNK_US ? us : PIT_MAX_CHUNK_US;
+        uint64_t ticks = ((uint64_t)chunk * PIT_FREQUENCY) / 1000000;
+
+        pit_wait_ticks(ticks ? ticks : 1);
+        us -= chunk;
+    }
+}
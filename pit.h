@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+
+#define PIT_FREQUENCY 1193182 /* Hz */
+
+/**
+ * Busy waits for the specified number of microseconds using channel 2 of
+ * the programmable interval timer. Only meant for early boot where no
+ * calibrated clock is available yet.
+ *
+ * @param us Time to wait in microseconds.
+ */
+void pit_udelay(uint32_t us);
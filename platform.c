@@ -1,10 +1,17 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <pmm.h>
+#include <balloc.h>
 #include <stdlib.h>
 #include <multiboot2.h>
 #include <init.h>
 #include <platform.h>
+#include <processor.h>
+#include <cpu_data.h>
+#include <acpi.h>
+#include <numa.h>
+#include <ioapic.h>
+#include <uart.h>
 
 #ifndef MEMBASE
 #define MEMBASE 0x0
@@ -13,6 +20,9 @@
 #define DEFAULT_MEMEND (16 * 1024 * 1024)
 #define HIGHMEM_PADDR  0x100000
 
+/* each high memory region may be split at node boundaries */
+#define MAX_PHYS_ZONES 32
+
 multiboot2_info_t *mbt_info __section(".data");
 
 mmu_initial_mapping_t mmu_initial_mappings[] = {
@@ -39,7 +49,8 @@ typedef struct boot_state {
 } boot_state_t;
 
 boot_state_t      bst;
-static pmm_zone_t phy_zones[10];
+static pmm_zone_t phy_zones[MAX_PHYS_ZONES];
+static uint32_t   num_phy_zones;
 
 void __init_func init_boot_state(void)
 {
@@ -48,6 +59,7 @@ void __init_func init_boot_state(void)
     multiboot2_tag_t const *tag = mbt_info->tags;
     multiboot2_tag_t const *end_tag =
         (multiboot2_tag_t *)((uintptr_t)mbt_info + mbt_info->total_size);
+    bool acpi_rsdp_found = false;
 
     while (tag < end_tag && tag->type != MULTIBOOT2_TAG_TYPE_END) {
         switch (tag->type) {
@@ -75,6 +87,18 @@ void __init_func init_boot_state(void)
                 }
             }
             break;
+
+        case MULTIBOOT2_TAG_TYPE_ACPI_OLD:
+            /* prefer the ACPI 2.0 RSDP if the bootloader provides both */
+            if (!acpi_rsdp_found) {
+                acpi_set_rsdp(((multiboot2_tag_acpi_t *)tag)->rsdp);
+            }
+            break;
+
+        case MULTIBOOT2_TAG_TYPE_ACPI_NEW:
+            acpi_set_rsdp(((multiboot2_tag_acpi_t *)tag)->rsdp);
+            acpi_rsdp_found = true;
+            break;
         }
 
         /* point to the next tag */
@@ -83,13 +107,97 @@ void __init_func init_boot_state(void)
     }
 }
 
+/**
+ * Registers the application processors listed in the MADT. Without ACPI,
+ * assume the logical processors of the boot package have contiguous APIC
+ * IDs.
+ */
+static void platform_init_cpus(void)
+{
+    if (acpi_madt_init()) {
+        return;
+    }
+
+    uint32_t eax, ebx, ecx, edx;
+    x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+
+    /* hyper-threading bit tells if the logical processor count is valid */
+    uint32_t count = (edx & (1 << 28)) ? (ebx >> 16) & 0xff : 1;
+    uint32_t bsp_id = x86_initial_apic_id();
+
+    for (uint32_t apic_id = 0; apic_id < count; ++apic_id) {
+        if (apic_id != bsp_id) {
+            processor_register(apic_id);
+        }
+    }
+}
+
+static void pmm_zone_add(paddr_t base, paddr_t end, uint32_t node)
+{
+    if (num_phy_zones == MAX_PHYS_ZONES) {
+        return;
+    }
+
+    pmm_zone_t *zone = &phy_zones[num_phy_zones];
+    zone->base = ROUND_UP(base, PAGE_SIZE);
+    zone->size = ROUND_DOWN(end, PAGE_SIZE) - zone->base;
+    zone->numa_node = node;
+
+    if (end > zone->base && zone->size) {
+        pmm_add_zone(zone);
+        num_phy_zones++;
+    }
+}
+
 static void pmm_zone_init(void)
 {
     for (uint32_t i = 0; i < bst.num_high_zones; ++i) {
-        phy_zones[i].base = ROUND_UP(bst.mem_high_zones[i].base, PAGE_SIZE);
-        phy_zones[i].size = ROUND_DOWN(bst.mem_high_zones[i].size, PAGE_SIZE);
+        paddr_t base = bst.mem_high_zones[i].base;
+        paddr_t end = base + bst.mem_high_zones[i].size;
+
+        /* split the region where it crosses a node boundary */
+        while (base < end) {
+            paddr_t  node_end;
+            uint32_t node = numa_addr_to_node(base, &node_end);
+
+            if (node_end > end) {
+                node_end = end;
+            }
 
-        pmm_add_zone(&phy_zones[i]);
+            pmm_zone_add(base, node_end, node);
+            base = node_end;
+        }
+    }
+}
+
+/* pages of the kernel image and of the boot allocator, never freed */
+static list_node_t boot_reserved_pages =
+    LIST_INITIAL_VALUE(boot_reserved_pages);
+
+/*
+ * The kernel is loaded at HIGHMEM_PADDR and the boot allocator carves its
+ * memory out right behind the image, so everything in the zones below
+ * boot_alloc_end is in use. Must run after the last pmm_add_zone(), which
+ * allocates the page arrays from the boot allocator.
+ */
+static void pmm_reserve_boot_memory(void)
+{
+    paddr_t end = PAGE_ALIGN(boot_alloc_end - KERNEL_VMA_BASE);
+
+    for (uint32_t i = 0; i < num_phy_zones; ++i) {
+        pmm_zone_t *zone = &phy_zones[i];
+        paddr_t     zone_end = zone->base + zone->size;
+
+        if (zone->base >= end) {
+            continue;
+        }
+
+        if (zone_end > end) {
+            zone_end = end;
+        }
+
+        pmm_alloc_range(zone->base, (zone_end - zone->base) / PAGE_SIZE,
+                        &boot_reserved_pages);
     }
 }
 
@@ -98,6 +206,23 @@ void platform_init(void)
     platform_init_debug();   /* setup serial debugging */
     platform_init_console(); /* setup the text console */
 
+    platform_init_interrupts();
+
     init_boot_state();
+
+    if (acpi_init()) {
+        acpi_srat_init();
+    }
+    numa_build_fallback_order();
+
+    /* per-CPU data and the AP stacks come from the boot allocator, which
+     * pmm_reserve_boot_memory() keeps out of the PMM's free lists */
+    platform_init_cpus();
+    secondary_cpus_init();
+
+    ioapic_init();
+    uart_enable_irq();
+
     pmm_zone_init();
+    pmm_reserve_boot_memory();
 }
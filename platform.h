@@ -1,9 +1,130 @@
 #pragma once
 
 #include <x86.h>
+#include <cpumask.h>
 
 void platform_init_console(void);
 void platform_init_debug(void);
 
-void platform_init_interrupt(void);
-void platform_int_handler(x86_interrupt_frame_t *frame);
+/**
+ * An interrupt service routine.
+ */
+typedef void (*isr_ptr_t)(void *arg);
+
+void platform_init_interrupts(void);
+/**
+ * Dispatches an external interrupt or IPI. Entered from the lean entry
+ * path in exception.S, which only saves the caller-saved registers.
+ *
+ * @param vector Interrupt vector.
+ */
+void platform_irq_handler(uint64_t vector);
+
+/**
+ * Installs the handler of an interrupt vector.
+ *
+ * @param vector Interrupt vector.
+ *
+ * @param callback Handler called with interrupts disabled.
+ *
+ * @param edge Whether the interrupt is edge triggered.
+ */
+void register_isr(uint32_t vector, isr_ptr_t callback, bool edge);
+
+/* Vectors handed out by irq_alloc_vectors(), between the legacy IRQs and
+ * the local APIC vectors */
+#define IRQ_DYNAMIC_VECTOR_FIRST 0x30
+#define IRQ_DYNAMIC_VECTOR_LAST  0xef
+
+/**
+ * Allocates a block of free vectors, e.g. for MSI.
+ *
+ * @param count Number of vectors, a power of two. The block is aligned to
+ * its size as multiple message MSI requires.
+ *
+ * @return First vector of the block, or -1 if there is no free block.
+ */
+int irq_alloc_vectors(uint32_t count);
+
+/**
+ * Releases vectors from irq_alloc_vectors() along with their handlers and
+ * routing.
+ */
+void irq_free_vectors(uint32_t vector, uint32_t count);
+
+/**
+ * Reprograms the hardware delivering an interrupt to send it to another
+ * processor.
+ *
+ * @return false if the processor cannot be reached.
+ */
+typedef bool (*irq_route_t)(uint32_t vector, uint32_t apic_id, void *data);
+
+/**
+ * CPUs device interrupts are sent to unless told otherwise. Clear the bits
+ * of the CPUs that run latency critical threads before the devices are
+ * set up.
+ */
+extern cpu_mask_t irq_default_affinity;
+
+/**
+ * Attaches the routing hardware of a device interrupt and sends the
+ * interrupt to a CPU of irq_default_affinity.
+ *
+ * @param vector Interrupt vector.
+ *
+ * @param route Function that retargets the interrupt.
+ *
+ * @param data Argument passed to the route function.
+ */
+void irq_set_route(uint32_t vector, irq_route_t route, void *data);
+
+/**
+ * Attaches routing hardware shared by a block of consecutive vectors, such
+ * as the single address register of a multiple message MSI block. The
+ * block moves as a unit through its first vector, the other vectors are
+ * not routable on their own.
+ *
+ * @param count Number of vectors in the block.
+ */
+void irq_set_route_block(uint32_t vector, uint32_t count, irq_route_t route,
+                         void *data);
+
+/**
+ * Restricts a device interrupt to a set of CPUs. The interrupt is moved
+ * if its current CPU is not part of the set.
+ *
+ * @return false if none of the CPUs is online and reachable.
+ */
+bool irq_set_affinity(uint32_t vector, cpu_mask_t mask);
+
+cpu_mask_t irq_get_affinity(uint32_t vector);
+
+/**
+ * Whether the vector has routing hardware attached, i.e. can be moved.
+ */
+bool irq_is_routable(uint32_t vector);
+
+/**
+ * Number of vectors that move together with the vector, 0 if it cannot be
+ * routed on its own.
+ */
+uint32_t irq_route_block_size(uint32_t vector);
+
+/**
+ * CPU the interrupt is currently sent to.
+ */
+uint32_t irq_get_target(uint32_t vector);
+
+/**
+ * Sends the interrupt to the specified CPU of its affinity mask.
+ *
+ * @return false if the CPU is not allowed or cannot be reached.
+ */
+bool irq_set_target(uint32_t vector, uint32_t cpu);
+
+/**
+ * Starts or stops spreading the busy device interrupts over the CPUs of
+ * their affinity masks according to their recent rate.
+ */
+void irq_balance_enable(bool enable);
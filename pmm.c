@@ -4,6 +4,11 @@
 #include <list.h>
 #include <pmm.h>
 #include <string.h>
+#include <counters.h>
+#include <cpu_data.h>
+#include <numa.h>
+#include <spinlock.h>
+#include <trace.h>
 
 #define FRAME_SIZE             PAGE_SIZE
 #define ZONE_FRAME_COUNT(zone) (zone->size / FRAME_SIZE)
@@ -12,9 +17,9 @@
     (((addr) >= (zone)->base) && ((addr) <= ((zone)->base + (zone)->size - 1)))
 
 #define PAGE_BELONGS_TO_ZONE(pgaddr, zone)                                     \
-    ((uintptr_t)(pgaddr) >= (uintptr_t)(zone)->page_array) &&                  \
-        ((uintptr_t)(pgaddr) <                                                 \
-         ((uintptr_t)(zone)->page_array + ZONE_FRAME_COUNT(zone)))
+    (((uintptr_t)(pgaddr) >= (uintptr_t)(zone)->page_array) &&                 \
+     ((uintptr_t)(pgaddr) < (uintptr_t)((zone)->page_array +                   \
+                                        ZONE_FRAME_COUNT(zone))))
 
 #define PAGE_INDEX_IN_ZONE(page, zone)                                         \
     (((uintptr_t)page - (uintptr_t)(zone)->page_array) / sizeof(vm_page_t))
@@ -25,6 +30,15 @@
 /* list of all the memory zones allocated by the pmm */
 static list_node_t zone_list = LIST_INITIAL_VALUE(zone_list);
 
+/* protects the free lists of all the zones */
+static spin_lock_t pmm_lock;
+
+/* next node of the interleave policy */
+DEFINE_PER_CPU(uint32_t, pmm_interleave_node);
+
+DEFINE_COUNTER(pages_allocated, "physical pages allocated");
+DEFINE_COUNTER(pages_freed, "physical pages freed");
+
 pmm_status_t pmm_add_zone(pmm_zone_t *zone)
 {
     if (!(zone->size > 0)) {
@@ -55,38 +69,22 @@ pmm_status_t pmm_add_zone(pmm_zone_t *zone)
     return PMM_NO_ERROR;
 }
 
-pmm_status_t pmm_alloc_pages(uint32_t *count, list_node_t *list)
+/* takes up to count free pages from the zones of a node, pmm_lock held */
+static uint32_t pmm_alloc_from_node(uint32_t node, uint32_t count,
+                                    list_node_t *list)
 {
-    /* fast path */
-    if (*count == 0) {
-        return PMM_NO_ERROR;
-    }
-    else if (*count == 1) {
-        *count = 0;
-
-        vm_page_t   *page;
-        pmm_status_t status = pmm_alloc_page(&page);
-
-        if (status == PMM_NO_ERROR) {
-            /* add allocated pages to the list */
-            list_add_tail(list, &page->node);
-            *count = 1;
-        }
-
-        return status;
-    }
-
-    /* num pages allocated */
     uint32_t allocated = 0;
 
     pmm_zone_t *zone;
     list_for_each_entry (zone, &zone_list, node) {
-        while ((allocated < *count) && (zone->free_count > 0)) {
+        if (zone->numa_node != node) {
+            continue;
+        }
+
+        while ((allocated < count) && (zone->free_count > 0)) {
             vm_page_t *page =
                 list_remove_head_type(&zone->free_pages, vm_page_t, node);
 
-            if (!page) goto done;
-
             page->flags |= VM_PAGE_FLAG_NONFREE;
             list_add_tail(list, &page->node);
 
@@ -95,37 +93,90 @@ pmm_status_t pmm_alloc_pages(uint32_t *count, list_node_t *list)
         }
 
         /* break when we have already allocated to required number of pages */
-        if (allocated == *count) {
+        if (allocated == count) {
             break;
         }
     }
 
-done:
-    *count = allocated;
+    return allocated;
+}
+
+/* walks the nodes by distance from the preferred one, pmm_lock held */
+static uint32_t pmm_alloc_fallback(uint32_t node, uint32_t count,
+                                   list_node_t *list)
+{
+    uint32_t allocated = 0;
+
+    for (uint32_t i = 0; i < numa_node_count && allocated < count; ++i) {
+        allocated += pmm_alloc_from_node(numa_fallback_node(node, i),
+                                         count - allocated, list);
+    }
+
+    return allocated;
+}
+
+pmm_status_t pmm_alloc_pages_node(uint32_t node, uint32_t *count,
+                                  list_node_t *list)
+{
+    if (*count == 0) {
+        return PMM_NO_ERROR;
+    }
+
+    if (node >= numa_node_count) {
+        return PMM_ERR_INVALID_ARGS;
+    }
+
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pmm_lock, &flags);
+    *count = pmm_alloc_fallback(node, *count, list);
+    spin_lock_unlock_irqrestore(&pmm_lock, flags);
+
+    counter_add(pages_allocated, *count);
+    TRACEPOINT(pmm_alloc, "node %llu count %llu", node, *count);
     return PMM_NO_ERROR;
 }
 
-pmm_status_t pmm_alloc_page(vm_page_t **out_page)
+pmm_status_t pmm_alloc_pages(uint32_t *count, list_node_t *list)
 {
-    /* walk through the arena searching for free page */
-    pmm_zone_t *zone;
-    list_for_each_entry (zone, &zone_list, node) {
-        /* allocate a page if the arena has free page */
-        if (zone->free_count > 0) {
-            vm_page_t *page =
-                list_remove_head_type(&zone->free_pages, vm_page_t, node);
-            if (!page) goto done;
+    return pmm_alloc_pages_node(get_current_cpu_node(), count, list);
+}
 
-            zone->free_count--;
+pmm_status_t pmm_alloc_pages_interleave(uint32_t *count, list_node_t *list)
+{
+    uint32_t allocated = 0;
 
-            page->flags |= VM_PAGE_FLAG_NONFREE;
-            *out_page = page;
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pmm_lock, &flags);
 
-            goto done;
+    /* interrupts are off, the rotor cannot change under us */
+    uint32_t node = this_cpu_read(pmm_interleave_node);
+    for (; allocated < *count; ++allocated) {
+        if (!pmm_alloc_fallback(node, 1, list)) {
+            break;
         }
+        node = (node + 1) % numa_node_count;
+    }
+    this_cpu_write(pmm_interleave_node, node);
+
+    spin_lock_unlock_irqrestore(&pmm_lock, flags);
+
+    *count = allocated;
+    counter_add(pages_allocated, allocated);
+    return PMM_NO_ERROR;
+}
+
+pmm_status_t pmm_alloc_page(vm_page_t **out_page)
+{
+    list_node_t list = LIST_INITIAL_VALUE(list);
+    uint32_t    count = 1;
+
+    *out_page = NULL;
+    pmm_alloc_pages(&count, &list);
+    if (!count) {
+        return PMM_ERR_NO_MEMORY;
     }
 
-done:
+    *out_page = list_remove_head_type(&list, vm_page_t, node);
     return PMM_NO_ERROR;
 }
 
@@ -140,6 +191,9 @@ size_t pmm_alloc_range(paddr_t address, size_t count, list_node_t *list)
 
     size_t allocated = 0;
 
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pmm_lock, &flags);
+
     /* walk through the arena, see if the physical page belongs to it */
     pmm_zone_t *zone;
     list_for_each_entry (zone, &zone_list, node) {
@@ -167,13 +221,19 @@ size_t pmm_alloc_range(paddr_t address, size_t count, list_node_t *list)
         if (allocated == count) break;
     }
 
-done:
+    spin_lock_unlock_irqrestore(&pmm_lock, flags);
+
+    counter_add(pages_allocated, allocated);
     return allocated;
 }
 
 size_t pmm_free_pages(list_t *head)
 {
     size_t count = 0;
+
+    uint64_t flags;
+    spin_lock_lock_irqsave(&pmm_lock, &flags);
+
     while (!list_is_empty(head)) {
         vm_page_t *page = list_remove_head_type(head, vm_page_t, node);
 
@@ -192,6 +252,10 @@ size_t pmm_free_pages(list_t *head)
         }
     }
 
+    spin_lock_unlock_irqrestore(&pmm_lock, flags);
+
+    counter_add(pages_freed, count);
+    TRACEPOINT(pmm_free, "count %llu", count);
     return count;
 }
 
@@ -290,6 +354,17 @@ void *pmm_alloc_kpages(size_t count, list_node_t *list)
 
 size_t pmm_free_kpages(void *ptr, uint32_t count)
 {
+    paddr_t pa = vaddr_to_paddr(ptr);
+    size_t  freed = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        vm_page_t *page = paddr_to_vm_page(pa + i * PAGE_SIZE);
+        if (page) {
+            freed += pmm_free_page(page);
+        }
+    }
+
+    return freed;
 }
 
 void *paddr_to_kvaddr(paddr_t pa)
@@ -305,6 +380,21 @@ void *paddr_to_kvaddr(paddr_t pa)
     return NULL;
 }
 
+paddr_t vaddr_to_paddr(void *vaddr)
+{
+    vaddr_t va = (vaddr_t)vaddr;
+
+    mmu_initial_mapping_t *map = mmu_initial_mappings;
+    while (map->size > 0) {
+        if ((va >= map->virt) && (va <= map->virt + map->size - 1)) {
+            return map->phys + (va - map->virt);
+        }
+        map++;
+    }
+
+    return -1;
+}
+
 paddr_t vm_page_to_paddr(vm_page_t *page)
 {
     pmm_zone_t *zone;
@@ -321,7 +411,7 @@ vm_page_t *paddr_to_vm_page(paddr_t addr)
 {
     pmm_zone_t *zone;
     list_for_each_entry (zone, &zone_list, node) {
-        if (PAGE_BELONGS_TO_ZONE(addr, zone)) {
+        if (ADDRESS_BELONGS_TO_ZONE(addr, zone)) {
             size_t index = (addr - zone->base) / PAGE_SIZE;
             return &zone->page_array[index];
         }
@@ -5,6 +5,7 @@
 #include <list.h>
 #include <types.h>
 #include <stdlib.h>
+#include <cpumask.h>
 
 #define PAGE_SIZE             4096
 #define PAGE_SIZE_SHIFT       12
@@ -33,6 +34,7 @@ typedef enum pmm_status {
     PMM_ERR_INVALID_ARENA_SIZE,
     PMM_ERR_CONTIGUOUS_PAGES_NOT_FOUND,
     PMM_ERR_INVALID_ARGS,
+    PMM_ERR_NO_MEMORY,
 } pmm_status_t;
 
 /**
@@ -45,6 +47,7 @@ typedef struct pmm_zone {
 
     paddr_t base;          /* Base address from where allocated pages starts. */
     size_t  size;          /* Total size of the zone. */
+    uint32_t numa_node;    /* NUMA node the memory is attached to. */
 
     vm_page_t *page_array; /* Array of pages allocated by this zone. */
 
@@ -55,7 +58,9 @@ typedef struct pmm_zone {
 pmm_status_t pmm_add_zone(pmm_zone_t *zone);
 
 /**
- * Allocates count non-contiguous pages of physical memory.
+ * Allocates count non-contiguous pages of physical memory. Pages come from
+ * the node of the calling CPU first, then from the other nodes in order of
+ * their distance.
  *
  * @param count Count of pages to allocate.
  *
@@ -65,7 +70,25 @@ pmm_status_t pmm_alloc_pages(uint32_t /* in/out */ *count,
                              /* out */ list_t      *list);
 
 /**
- * Allocates a single page of physical memory.
+ * Same as pmm_alloc_pages() but prefers the specified node over the node
+ * of the calling CPU.
+ *
+ * @param node Preferred NUMA node.
+ */
+pmm_status_t pmm_alloc_pages_node(uint32_t node, uint32_t /* in/out */ *count,
+                                  /* out */ list_t                    *list);
+
+/**
+ * Allocates count non-contiguous pages spread round-robin over all the
+ * nodes. Meant for large, long lived buffers shared by all the CPUs, where
+ * even spreading beats local placement.
+ */
+pmm_status_t pmm_alloc_pages_interleave(uint32_t /* in/out */ *count,
+                                        /* out */ list_t      *list);
+
+/**
+ * Allocates a single page of physical memory from the node of the
+ * calling CPU if possible.
  *
  * @param page Page allocated.
  */
@@ -143,11 +166,29 @@ typedef struct vm_aspace {
     size_t  size;
 
     list_node_t region_list;
+
+    /* CPUs that may hold TLB entries of this address space */
+    cpu_mask_t active_cpus;
 } vm_aspace_t;
 
+extern vm_aspace_t kernel_aspace;
+
 void         vmm_init_preheap(void);
 vm_aspace_t *vaddr_to_vm_aspace(vaddr_t addr);
 
+/**
+ * Marks the address space as loaded on the current CPU, which makes the CPU
+ * a target of its TLB shootdowns.
+ */
+void vmm_aspace_activate(vm_aspace_t *aspace);
+
+/**
+ * Removes the current CPU from the address space's shootdown targets. The
+ * CPU must load another address space before it stops taking shootdowns,
+ * the CR3 switch drops the stale entries.
+ */
+void vmm_aspace_deactivate(vm_aspace_t *aspace);
+
 /**
  * Allocates a physical page and maps it to the virtual page.
  *
@@ -4,9 +4,10 @@
 #include <compiler.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
+#include <console/kprint.h>
 
-#define INT32_MAX  0x7fffffff
-#define UINT32_MAX 0xffffffff
+#define INT32_MAX 0x7fffffff
 
 #define isdigit(c) (((c) >= '0') && ((c) <= '9'))
 #define chtod(c)   ((c) - '0')
@@ -30,35 +31,141 @@ enum number_type {
     FORMAT_TYPE_SIZE_T,
 };
 
-/* TODO: fix this */
-int __printf_internal(const char *fmt, va_list                  argp,
-                      void (*putc)(uint8_t c, void *arg), void *arg)
+/* receives the output in runs rather than a character at a time */
+typedef void (*printf_write_t)(const char *str, size_t len, void *arg);
+
+/* "00" to "99", the decimal conversion emits two digits per division */
+static const char digit_pairs[201] = "0001020304050607080910111213141516171819"
+                                     "2021222324252627282930313233343536373839"
+                                     "4041424344454647484950515253545556575859"
+                                     "6061626364656667686970717273747576777879"
+                                     "8081828384858687888990919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+static const char hex_digits_caps[] = "0123456789ABCDEF";
+
+static const char pad_spaces[] = "                ";
+static const char pad_zeros[] = "0000000000000000";
+
+/* a 64-bit value in octal plus room to spare */
+#define NUM_BUF_SIZE 24
+
+/* the conversions below fill the buffer backwards from its end and return
+ * the first digit */
+
+static char *format_decimal(char *end, uint64_t n)
+{
+    while (n >= 100) {
+        uint32_t pair = (n % 100) * 2;
+
+        n /= 100;
+        *--end = digit_pairs[pair + 1];
+        *--end = digit_pairs[pair];
+    }
+
+    if (n >= 10) {
+        *--end = digit_pairs[n * 2 + 1];
+        *--end = digit_pairs[n * 2];
+    }
+    else {
+        *--end = '0' + n;
+    }
+
+    return end;
+}
+
+static char *format_hex(char *end, uint64_t n, const char *digits)
+{
+    do {
+        *--end = digits[n & 0xf];
+        n >>= 4;
+    } while (n);
+
+    return end;
+}
+
+static char *format_octal(char *end, uint64_t n)
+{
+    do {
+        *--end = '0' + (n & 0x7);
+        n >>= 3;
+    } while (n);
+
+    return end;
+}
+
+static void printf_pad(printf_write_t write, void *arg, const char *pad,
+                       size_t count)
+{
+    while (count) {
+        size_t chunk = count < sizeof(pad_spaces) - 1 ? count
+                                                      : sizeof(pad_spaces) - 1;
+
+        write(pad, chunk, arg);
+        count -= chunk;
+    }
+}
+
+/* writes prefix, zeros and str padded to the field width */
+static size_t printf_field(printf_write_t write, void *arg, const char *prefix,
+                           size_t prefix_len, size_t zeros, const char *str,
+                           size_t len, uint32_t width, uint32_t flags)
+{
+    size_t total = prefix_len + zeros + len;
+    size_t pad = width > total ? width - total : 0;
+
+    if (!(flags & LEFT)) {
+        printf_pad(write, arg, pad_spaces, pad);
+    }
+    if (prefix_len) {
+        write(prefix, prefix_len, arg);
+    }
+    printf_pad(write, arg, pad_zeros, zeros);
+    if (len) {
+        write(str, len, arg);
+    }
+    if (flags & LEFT) {
+        printf_pad(write, arg, pad_spaces, pad);
+    }
+
+    return total + pad;
+}
+
+int __printf_internal(const char *fmt, va_list argp, printf_write_t write,
+                      void *arg)
 {
+    char     num[NUM_BUF_SIZE];
+    char    *end = num + sizeof(num);
     char     c;
     uint64_t n;
     uint32_t flags;
     uint8_t  ntype;
     uint8_t  padc;
-    uint32_t precision;
-    uint32_t base;
+    int32_t  precision;
     uint32_t width;
     int      printed = 0;
 
-    while ((c = *fmt) != '\0') {
-        if (c != '%') {
-            putc(c, arg);
+    while (*fmt != '\0') {
+        /* literal text up to the next conversion goes out in one piece */
+        const char *run = fmt;
+
+        while (*fmt != '\0' && *fmt != '%') {
             fmt++;
-            printed++;
+        }
+
+        if (fmt != run) {
+            write(run, fmt - run, arg);
+            printed += fmt - run;
             continue;
         }
 
         /* consume '%' */
         fmt++;
 
+        flags = 0;
         padc = ' ';
         width = 0;
         precision = -1;
-        base = 10;
         ntype = FORMAT_TYPE_NONE;
 
         while (1) {
@@ -71,6 +178,8 @@ int __printf_internal(const char *fmt, va_list                  argp,
                 flags |= SPACE;
             } else if (c == '#') {
                 flags |= ALT;
+            } else if (c == '0') {
+                padc = '0';
             } else {
                 break;
             }
@@ -78,197 +187,204 @@ int __printf_internal(const char *fmt, va_list                  argp,
             ++fmt;
         }
 
-        if (c == '0') {
-            padc = '0';
-            c = *fmt++;
-        }
-
         /* field width */
-        if (isdigit(c)) {
-            while (isdigit(c)) {
-                width = 10 * width + chtod(c);
-                c = *fmt++;
+        if (*fmt == '*') {
+            int32_t w = va_arg(argp, int);
+
+            if (w < 0) {
+                flags |= LEFT;
+                w = -w;
             }
-        } else if (c == '*') {
-            width = va_arg(argp, int);
-            c = *fmt++;
-            if (width < 0) {
-                flags &= ~LEFT;
-                width = -width;
+            width = w;
+            fmt++;
+        } else {
+            while (isdigit(*fmt)) {
+                width = 10 * width + chtod(*fmt++);
             }
         }
 
         /* precision */
-        if (c == '.') {
-            c = *fmt++;
-            if (isdigit(c)) {
-                precision = 0;
-                while (isdigit(c)) {
-                    precision = 10 * precision + chtod(c);
-                    c = *fmt++;
-                }
-            } else if (c == '*') {
+        if (*fmt == '.') {
+            fmt++;
+            precision = 0;
+            if (*fmt == '*') {
                 precision = va_arg(argp, int);
-                c = *fmt++;
+                if (precision < 0) {
+                    precision = -1;
+                }
+                fmt++;
+            } else {
+                while (isdigit(*fmt)) {
+                    precision = 10 * precision + chtod(*fmt++);
+                }
             }
         }
 
+        c = *fmt;
         if (c == 'l') {
             ntype = FORMAT_TYPE_LONG;
-            c = *fmt++;
+            c = *++fmt;
             if (c == 'l') {
                 ntype = FORMAT_TYPE_LONG_LONG;
-                c = *fmt++;
+                c = *++fmt;
             }
         } else if (c == 'h') {
-            c = *fmt++;
             ntype = FORMAT_TYPE_SHORT;
+            c = *++fmt;
             if (c == 'h') {
                 ntype = FORMAT_TYPE_CHAR;
-                c = *fmt++;
+                c = *++fmt;
             }
-        } else if (c == 'q' || c == 'L') {
-            ntype = FORMAT_TYPE_LONG;
-            c = *fmt++;
+        } else if (c == 'q' || c == 'L' || c == 'j') {
+            ntype = FORMAT_TYPE_LONG_LONG;
+            c = *++fmt;
+        } else if (c == 'z' || c == 'Z' || c == 't') {
+            ntype = FORMAT_TYPE_SIZE_T;
+            c = *++fmt;
         }
 
-        if (c == 'z' || c == 'Z') {
-            ntype = FORMAT_TYPE_SIZE_T;
+        /* a '%' ending the format string */
+        if (c == '\0') {
+            break;
         }
+        fmt++;
+
+        const char *digits;
+        const char *prefix = NULL;
+        size_t      prefix_len = 0;
+        char        sign;
 
         switch (c) {
         case 'c':
-            c = (char)va_arg(argp, int);
-            (*putc)(c, arg);
-            printed++;
-            break;
+            num[0] = (char)va_arg(argp, int);
+            printed += printf_field(write, arg, NULL, 0, 0, num, 1, width,
+                                    flags);
+            continue;
 
         case 's': {
             const char *s = va_arg(argp, char *);
-            const char *ssaved;
-
-            bool ladjust = (flags & LEFT);
-
-            if (precision == -1) {
-                precision = INT32_MAX;
-            }
+            size_t      len = 0;
 
             if (s == NULL) {
                 s = "<null>";
             }
 
-            if (width > 0 && !ladjust) {
-                n = 0;
-                ssaved = s;
+            while (s[len] != '\0' &&
+                   (precision < 0 || len < (size_t)precision)) {
+                len++;
+            }
 
-                for (; *s != '\0' && n < precision; s++) {
-                    n++;
-                }
+            printed += printf_field(write, arg, NULL, 0, 0, s, len, width,
+                                    flags);
+            continue;
+        }
 
-                s = ssaved;
+        case 'i':
+            __fallthrough;
+        case 'd': {
+            int64_t v;
 
-                while (n < width) {
-                    (*putc)(' ', arg);
-                    n++;
-                    printed++;
-                }
+            if (ntype == FORMAT_TYPE_LONG_LONG || ntype == FORMAT_TYPE_LONG ||
+                ntype == FORMAT_TYPE_SIZE_T) {
+                v = va_arg(argp, long long);
+            } else {
+                v = va_arg(argp, int);
             }
 
-            n = 0;
-            while ((n < precision) && (!((width > 0) && (n >= width)))) {
-                if (*s == '\0') {
-                    break;
-                }
-
-                (*putc)(*s++, arg);
-                n++;
-                printed++;
+            if (ntype == FORMAT_TYPE_CHAR) {
+                v = (int8_t)v;
+            } else if (ntype == FORMAT_TYPE_SHORT) {
+                v = (int16_t)v;
             }
 
-            if (n < width && ladjust) {
-                while (n < width) {
-                    (*putc)(' ', arg);
-                    n++;
-                    printed++;
-                }
+            n = v < 0 ? -(uint64_t)v : (uint64_t)v;
+            sign = v < 0             ? '-'
+                   : (flags & PLUS)  ? '+'
+                   : (flags & SPACE) ? ' '
+                                     : 0;
+            if (sign) {
+                num[0] = sign;
+                prefix = num;
+                prefix_len = 1;
             }
+
+            digits = format_decimal(end, n);
+            goto print_number;
         }
 
+        case 'p':
+            n = (uintptr_t)va_arg(argp, void *);
+            prefix = "0x";
+            prefix_len = 2;
+            digits = format_hex(end, n, hex_digits);
+            goto print_number;
+
         case 'o':
-            __fallthrough;
         case 'O':
-            base = 8;
-            goto print_unsigned;
-
-        case 'i':
-            __fallthrough;
-        case 'd':
-            base = 10;
-            flags |= SIGN;
-            goto print_signed;
-
-        case 'U':
-            flags |= CAPS;
-            __fallthrough;
         case 'u':
-            goto print_unsigned;
-
-        case 'p':
-            flags |= ALT;
-            __fallthrough;
-        case 'X':
-            flags |= CAPS;
-            base = 16;
-            __fallthrough;
+        case 'U':
         case 'x':
-            if (flags & ALT) {
-                (*putc)(c, arg);
-            }
-            break;
-
-print_signed:
-            if (ntype == FORMAT_TYPE_LONG_LONG) {
-                n = va_arg(argp, long long);
-            } else if (ntype == FORMAT_TYPE_LONG) {
-                n = va_arg(argp, long);
+        case 'X':
+            if (ntype == FORMAT_TYPE_LONG_LONG || ntype == FORMAT_TYPE_LONG ||
+                ntype == FORMAT_TYPE_SIZE_T) {
+                n = va_arg(argp, unsigned long long);
             } else {
-                n = va_arg(argp, int);
+                n = va_arg(argp, unsigned int);
             }
 
-            switch (ntype) {
-            case FORMAT_TYPE_CHAR:
-                n = (int8_t)n;
-                break;
-            case FORMAT_TYPE_SHORT:
-                n = (int16_t)n;
-                break;
-            default:
-                break;
+            if (ntype == FORMAT_TYPE_CHAR) {
+                n = (uint8_t)n;
+            } else if (ntype == FORMAT_TYPE_SHORT) {
+                n = (uint16_t)n;
             }
 
-print_unsigned:
-            if (ntype == FORMAT_TYPE_LONG_LONG) {
-                n = va_arg(argp, unsigned long long);
-            } else if (ntype == FORMAT_TYPE_LONG) {
-                n = va_arg(argp, unsigned long);
+            if (c == 'x' || c == 'X') {
+                digits = format_hex(end, n, c == 'X' ? hex_digits_caps
+                                                     : hex_digits);
+                if ((flags & ALT) && n) {
+                    prefix = c == 'X' ? "0X" : "0x";
+                    prefix_len = 2;
+                }
+            } else if (c == 'o' || c == 'O') {
+                digits = format_octal(end, n);
+                if ((flags & ALT) && n) {
+                    prefix = "0";
+                    prefix_len = 1;
+                }
             } else {
-                n = va_arg(argp, unsigned int);
+                digits = format_decimal(end, n);
             }
 
-            switch (ntype) {
-            case FORMAT_TYPE_CHAR:
-                n = (uint8_t)n;
-                break;
-            case FORMAT_TYPE_SHORT:
-                n = (uint16_t)n;
-                break;
-            default:
-                break;
+print_number: {
+            size_t len = end - digits;
+            size_t zeros = 0;
+
+            /* an explicit zero precision prints nothing for a zero */
+            if (precision == 0 && n == 0) {
+                len = 0;
+            }
+
+            if (precision >= 0) {
+                if ((size_t)precision > len) {
+                    zeros = precision - len;
+                }
+            } else if (padc == '0' && !(flags & LEFT) &&
+                       width > prefix_len + len) {
+                zeros = width - prefix_len - len;
             }
 
+            printed += printf_field(write, arg, prefix, prefix_len, zeros,
+                                    digits, len, width, flags);
+            continue;
+        }
+
+        case '%':
+            __fallthrough;
         default:
-            (*putc)(c, arg);
-            break;
+            /* unknown conversions are printed as they are */
+            write(&c, 1, arg);
+            printed++;
+            continue;
         }
     }
 
@@ -293,13 +409,20 @@ typedef struct snprintf_arg {
     size_t pos;
 } snprintf_arg_t;
 
-static void vsnprintf_internal(uint8_t c, void *arg)
+static void vsnprintf_internal(const char *str, size_t len, void *arg)
 {
     snprintf_arg_t *const args = arg;
 
-    if (args->pos < args->size - 1) {
-        args->data[args->pos++] = c;
+    /* the output is cut short, the length is still counted */
+    if (args->pos + 1 >= args->size) {
+        return;
+    }
+    if (len > args->size - 1 - args->pos) {
+        len = args->size - 1 - args->pos;
     }
+
+    memcpy(args->data + args->pos, str, len);
+    args->pos += len;
 }
 
 int vsnprintf(char *str, size_t size, const char *fmt, va_list argp)
@@ -322,8 +445,7 @@ int vsnprintf(char *str, size_t size, const char *fmt, va_list argp)
 
 int vprintf(const char *fmt, va_list args)
 {
-    /* return vsnprintf(, INT_MAX, fmt, args); */
-    return 0;
+    return vkprintf(KLOG_LEVEL_INFO, fmt, args);
 }
 
 int vsprintf(char *str, const char *fmt, va_list args)
@@ -1,10 +1,13 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <processor.h>
-
-#define MAX_NCPUS 64
+#include <percpu.h>
+#include <x86.h>
 
 processor_t processor_array[MAX_NCPUS];
+uint32_t    processor_count;
+
+list_t processor_list;
 
 processor_set_t default_pset;
 
@@ -14,19 +17,33 @@ uint8_t pset_count;
 extern list_t   thread_list;
 extern uint32_t thread_count;
 
-processor_t bsp; /* bootstrap processor */
-
 void processor_bootstrap(void)
 {
     list_init(&processor_list);
 
     list_init(&pset_list);
+    pset_init(&default_pset);
     list_add(&pset_list, &default_pset.pset_list_node);
     pset_count = 1;
 
-    /* Initialize the bootstrap processor */
-    processor_array[0] = bsp;
-    processor_init(&bsp, 0, &default_pset);
+    /* the bootstrap processor is always cpu 0 */
+    processor_t *bsp = processor_register(x86_initial_apic_id());
+    bsp->state = PROCESSOR_STATE_RUNNING;
+}
+
+processor_t *processor_register(uint32_t apic_id)
+{
+    if (processor_count >= MAX_NCPUS) {
+        return NULL;
+    }
+
+    uint32_t     num = processor_count++;
+    processor_t *processor = &processor_array[num];
+
+    processor_init(processor, num, &default_pset);
+    processor->apic_id = apic_id;
+
+    return processor;
 }
 
 void pset_init(processor_set_t *pset)
@@ -47,9 +64,12 @@ void pset_init(processor_set_t *pset)
 void processor_init(processor_t *processor, uint32_t num, processor_set_t *pset)
 {
     processor->cpu_number = num;
+    processor->state = PROCESSOR_STATE_NA;
+    processor->current_thread = NULL;
     processor->pset = NULL;
 
-    processor->idle_thread;
+    list_add_tail(&processor_list, &processor->plist_node);
+    pset_add_processor(processor, pset);
 }
 
 void pset_add_processor(processor_t *processor, processor_set_t *pset)
@@ -4,6 +4,7 @@
 
 #include <stdbool.h>
 #include <thread.h>
+#include <percpu.h>
 
 typedef struct processor_set processor_set_t;
 
@@ -40,10 +41,13 @@ typedef struct processor {
     thread_t  idle_thread;
 
     uint32_t         cpu_number;
-    processor_set_t *pset; /* Processor set this processor belongs to. */
+    uint32_t         apic_id; /* Local APIC ID. */
+    processor_set_t *pset;    /* Processor set this processor belongs to. */
 } processor_t;
 
-extern list_t processor_list;
+extern list_t      processor_list;
+extern processor_t processor_array[MAX_NCPUS];
+extern uint32_t    processor_count;
 
 /**
  * Initialize the processor set system.
@@ -62,6 +66,16 @@ void pset_remove_thread(processor_set_t *pset, thread_t *thread);
  */
 void processor_bootstrap(void);
 
+/**
+ * Registers a processor discovered by the platform code and assigns it the
+ * next free CPU number.
+ *
+ * @param apic_id Local APIC ID of the processor.
+ *
+ * @return Processor object or NULL if there are too many processors.
+ */
+processor_t *processor_register(uint32_t apic_id);
+
 /**
  * Initialize a processor object and assign it to a processor-set.
  *
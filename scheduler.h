@@ -4,7 +4,8 @@
 
 /**
  * Executes another thread. It simply picks the next thread
- * from the queue and executes it.
+ * from the queue and executes it. Must be called with interrupts
+ * disabled.
  */
 void thread_reschedule(void);
 
@@ -21,7 +22,8 @@ void thread_yield(void);
  * Block the current running thread.
  *
  * The function doesn't return until the thread is unblocked
- * by some other module.
+ * by some other module. Callers make the wakeup condition visible
+ * with interrupts disabled, or the wakeup may be lost.
  */
 void thread_block(void);
 
@@ -29,3 +31,9 @@ void thread_block(void);
  * Unblock the specified thread.
  */
 void thread_unblock(thread_t *t);
+
+/**
+ * Switches threads if the current one was asked to give up the CPU. Called
+ * with interrupts disabled on the way out of an interrupt.
+ */
+void thread_preempt(void);
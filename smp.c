@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <smp.h>
+#include <apic.h>
+#include <cpu_data.h>
+#include <init.h>
+#include <mmu.h>
+#include <pit.h>
+#include <platform.h>
+#include <spinlock.h>
+#include <string.h>
+#include <thread.h>
+#include <tlb.h>
+#include <x86.h>
+
+/* time the APs get to check in after the STARTUP IPI */
+#define SMP_AP_TIMEOUT_US 100000
+#define SMP_AP_POLL_US    10
+
+/* trampoline.S */
+extern uint8_t  trampoline[];
+extern uint8_t  trampoline_end[];
+extern uint32_t trampoline_cr3;
+
+/* Access a trampoline variable inside the copy at SMP_TRAMPOLINE_BASE */
+#define TRAMPOLINE_VAR(var)                                                    \
+    (*(__typeof__(var) *)(KERNEL_VMA_BASE + SMP_TRAMPOLINE_BASE +              \
+                          ((uintptr_t) & (var) - (uintptr_t)trampoline)))
+
+/*
+ * All the APs are started at once, so each of them looks up its cpu number
+ * and boot stack by its APIC ID in these tables (see ap_start64).
+ */
+uint32_t  smp_boot_ncpus;
+uint32_t  smp_boot_apic_id[MAX_NCPUS];
+uintptr_t smp_boot_stack[MAX_NCPUS];
+
+/* rendezvous counter, the APs increment it once they are initialized */
+uint32_t smp_cpus_online = 1;
+
+/* set by the boot processor once the bring-up is done */
+static bool smp_boot_done;
+
+/* stop_machine() state, the CPUs holding in the IPI and their release */
+static spin_lock_t stop_lock;
+static uint32_t    stop_count;
+static bool        stop_release;
+
+static void smp_wait_online(uint32_t count)
+{
+    for (uint32_t waited = 0; waited < SMP_AP_TIMEOUT_US;
+         waited += SMP_AP_POLL_US) {
+        if (__atomic_load_n(&smp_cpus_online, __ATOMIC_ACQUIRE) >= count) {
+            return;
+        }
+        pit_udelay(SMP_AP_POLL_US);
+    }
+}
+
+void smp_init(void)
+{
+    /* bring up the local APIC of the boot processor first */
+    apic_create_mapping();
+    lapic_init();
+    lapic_timer_init();
+
+    if (num_cpus == 1) {
+        return;
+    }
+
+    for (uint32_t num = 0; num < num_cpus; ++num) {
+        cpu_data_t *cpu = get_cpu_data(num);
+
+        smp_boot_apic_id[num] = cpu->cpu_processor->apic_id;
+        smp_boot_stack[num] = cpu->cpu_stack_top;
+        if (num) {
+            cpu->cpu_processor->state = PROCESSOR_STATE_STARTING;
+        }
+    }
+    smp_boot_ncpus = num_cpus;
+
+    /* copy the trampoline into low memory */
+    memcpy((void *)(KERNEL_VMA_BASE + SMP_TRAMPOLINE_BASE), trampoline,
+           trampoline_end - trampoline);
+    TRAMPOLINE_VAR(trampoline_cr3) = x86_get_cr3();
+
+    /* the trampoline enables paging while running from low memory */
+    x86_mmu_map_low_identity();
+
+    /* INIT-SIPI-SIPI sequence, broadcast to all the APs */
+    lapic_broadcast_init();
+    pit_udelay(10000);
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        lapic_broadcast_startup(SMP_TRAMPOLINE_BASE);
+        pit_udelay(200);
+    }
+
+    /* the APs initialize themselves in parallel, wait for all to check in */
+    smp_wait_online(num_cpus);
+
+    for (uint32_t num = 1; num < num_cpus; ++num) {
+        cpu_data_t *cpu = get_cpu_data(num);
+
+        /* the processor did not come up */
+        if (!__atomic_load_n(&cpu->cpu_running, __ATOMIC_ACQUIRE)) {
+            cpu->cpu_processor->state = PROCESSOR_STATE_NA;
+        }
+    }
+
+    x86_mmu_unmap_low_identity();
+
+    /* release the APs */
+    __atomic_store_n(&smp_boot_done, true, __ATOMIC_RELEASE);
+}
+
+void secondary_cpu_main(uint32_t num)
+{
+    percpu_load(num);
+
+    /* per-CPU control register setup */
+    x86_mmu_init();
+    lapic_init();
+    lapic_timer_init();
+
+    cpu_data_t  *cpu = get_current_cpu_data();
+    processor_t *processor = cpu->cpu_processor;
+
+    create_bootstrap_thread(&processor->idle_thread);
+    cpu->cpu_current_thread = &processor->idle_thread;
+
+    kernel_init_percpu();
+
+    processor->state = PROCESSOR_STATE_RUNNING;
+    __atomic_store_n(&cpu->cpu_running, true, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&smp_cpus_online, 1, __ATOMIC_RELEASE);
+
+    while (!__atomic_load_n(&smp_boot_done, __ATOMIC_ACQUIRE)) {
+        x86_pause();
+    }
+
+    /* flush the identity mapping the boot processor has torn down */
+    x86_set_cr3(x86_get_cr3());
+
+    thread_idle_loop();
+}
+
+static void stop_machine_ipi(void *arg)
+{
+    __atomic_fetch_add(&stop_count, 1, __ATOMIC_ACQ_REL);
+
+    /* a CPU that has not taken the IPI yet may be waiting on us for a
+     * shootdown */
+    while (!__atomic_load_n(&stop_release, __ATOMIC_ACQUIRE)) {
+        tlb_poll();
+        x86_pause();
+    }
+
+    __atomic_fetch_sub(&stop_count, 1, __ATOMIC_RELEASE);
+}
+
+void stop_machine(void (*fn)(void *arg), void *arg)
+{
+    uint64_t flags = x86_save_flags();
+    uint32_t self, targets = 0;
+
+    /* interrupts stay enabled while waiting for the lock, the holder is
+     * about to stop this CPU */
+    while (1) {
+        x86_cli();
+        if (spin_lock_trylock(&stop_lock)) {
+            break;
+        }
+        x86_restore_flags(flags);
+        x86_pause();
+    }
+
+    self = get_current_cpu_number();
+    for (uint32_t cpu = 0; cpu < num_cpus; ++cpu) {
+        if (cpu == self ||
+            !__atomic_load_n(&get_cpu_data(cpu)->cpu_running,
+                             __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        lapic_send_ipi_fixed(get_cpu_data(cpu)->cpu_lapic_id,
+                             IPI_STOP_MACHINE_VECTOR);
+        targets++;
+    }
+
+    while (__atomic_load_n(&stop_count, __ATOMIC_ACQUIRE) != targets) {
+        tlb_poll();
+        x86_pause();
+    }
+
+    fn(arg);
+
+    __atomic_store_n(&stop_release, true, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&stop_count, __ATOMIC_ACQUIRE)) {
+        x86_pause();
+    }
+    __atomic_store_n(&stop_release, false, __ATOMIC_RELAXED);
+
+    spin_lock_unlock(&stop_lock);
+    x86_restore_flags(flags);
+}
+
+static void stop_machine_percpu_init(const void *arg)
+{
+    register_isr(IPI_STOP_MACHINE_VECTOR, stop_machine_ipi, true);
+}
+
+REGISTER_INIT_HOOK(stop_machine, PERCPU, 7, &stop_machine_percpu_init, NULL);
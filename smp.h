@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+/* Physical address the real-mode trampoline is copied to. */
+#define SMP_TRAMPOLINE_BASE 0x8000
+
+#ifndef __ASSEMBLY__
+
+#include <stdint.h>
+#include <compiler.h>
+
+/**
+ * Number of processors that are up and running.
+ */
+extern uint32_t smp_cpus_online;
+
+/**
+ * Starts all the application processors registered by the platform code.
+ * Must be called by the boot processor once the per-CPU data of every
+ * processor is set up.
+ */
+void smp_init(void);
+
+/**
+ * C entry point of the application processors, called by the trampoline
+ * on the processor's boot stack.
+ *
+ * @param cpu CPU number of the calling processor.
+ */
+void secondary_cpu_main(uint32_t cpu) __noreturn;
+
+/**
+ * Runs a function on the calling CPU while every other online CPU spins
+ * with interrupts disabled, for changes no other CPU may observe half done
+ * such as patching kernel code. Must be called with interrupts enabled.
+ *
+ * @param fn Function to run, with interrupts disabled.
+ *
+ * @param arg Argument passed to the function.
+ */
+void stop_machine(void (*fn)(void *arg), void *arg);
+
+#endif /* !__ASSEMBLY__ */
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <softirq.h>
+#include <clock.h>
+#include <cpu_data.h>
+#include <init.h>
+#include <percpu.h>
+#include <scheduler.h>
+#include <thread.h>
+#include <x86.h>
+
+/* work done on interrupt exit before the rest goes to ksoftirqd */
+#define SOFTIRQ_MAX_RESTART 10
+#define SOFTIRQ_MAX_TIME_NS (2 * NSEC_PER_MSEC)
+
+#define TASKLET_STATE_SCHED (1 << 0) /* Queued. */
+#define TASKLET_STATE_RUN   (1 << 1) /* Running on some CPU. */
+
+typedef struct softirq_cpu {
+    uint32_t  pending;  /* Raised softirqs, interrupts off to touch it. */
+    bool      active;   /* Handlers are running. */
+    bool      deferred; /* ksoftirqd owns the pending work. */
+    thread_t *thread;   /* ksoftirqd */
+
+    list_t tasklets[2]; /* Queued normal and high priority tasklets. */
+} softirq_cpu_t;
+
+DEFINE_PER_CPU(softirq_cpu_t, softirq_cpu);
+
+/* interrupt.c */
+DECLARE_PER_CPU(uint32_t, irq_nesting);
+
+static softirq_handler_t softirq_handlers[NUM_SOFTIRQS];
+
+void softirq_register(softirq_nr_t nr, softirq_handler_t handler)
+{
+    softirq_handlers[nr] = handler;
+}
+
+/*
+ * Marks a softirq pending, interrupts disabled. Raised from a thread no
+ * interrupt exit is coming to run it and an idle CPU may not take an
+ * interrupt for a long time, so ksoftirqd is woken up instead.
+ *
+ * @param flags Flags saved before interrupts were disabled. A caller that
+ * already had them disabled may hold a run queue lock or be panicking, its
+ * work waits for the next interrupt exit.
+ */
+static void softirq_mark(softirq_cpu_t *sc, softirq_nr_t nr, uint64_t flags)
+{
+    sc->pending |= 1U << nr;
+
+    if ((flags & X86_FLAGS_IF) && !this_cpu_read(irq_nesting) &&
+        !sc->active && !sc->deferred && sc->thread) {
+        sc->deferred = true;
+        thread_unblock(sc->thread);
+    }
+}
+
+void softirq_raise(softirq_nr_t nr)
+{
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    softirq_mark(this_cpu_ptr(softirq_cpu), nr, flags);
+
+    x86_restore_flags(flags);
+}
+
+bool softirq_active(void)
+{
+    return this_cpu_ptr(softirq_cpu)->active;
+}
+
+/*
+ * Runs the pending handlers until nothing is left or the budget is spent.
+ * Interrupts disabled on entry and exit.
+ *
+ * @return true if work is left.
+ */
+static bool softirq_run(softirq_cpu_t *sc)
+{
+    uint64_t end = clock_monotonic_ns() + SOFTIRQ_MAX_TIME_NS;
+
+    sc->active = true;
+
+    for (uint32_t round = 0; sc->pending; ++round) {
+        if (round == SOFTIRQ_MAX_RESTART || clock_monotonic_ns() > end) {
+            break;
+        }
+
+        uint32_t pending = sc->pending;
+        sc->pending = 0;
+
+        x86_sti();
+        while (pending) {
+            uint32_t nr = __builtin_ctz(pending);
+            pending &= pending - 1;
+
+            if (softirq_handlers[nr]) {
+                softirq_handlers[nr]();
+            }
+        }
+        x86_cli();
+    }
+
+    sc->active = false;
+    return sc->pending;
+}
+
+void softirq_irq_exit(void)
+{
+    softirq_cpu_t *sc = this_cpu_ptr(softirq_cpu);
+
+    /* nested in running handlers, or ksoftirqd is behind on the work */
+    if (!sc->pending || sc->active || sc->deferred) {
+        return;
+    }
+
+    if (softirq_run(sc) && sc->thread) {
+        sc->deferred = true;
+        thread_unblock(sc->thread);
+    }
+}
+
+static void ksoftirqd(void *arg)
+{
+    softirq_cpu_t *sc = this_cpu_ptr(softirq_cpu);
+
+    for (;;) {
+        /* raised only by this CPU, checking with interrupts off cannot miss
+         * a wakeup */
+        x86_cli();
+        if (!sc->pending) {
+            sc->deferred = false;
+            thread_block();
+        }
+
+        softirq_run(sc);
+
+        /* let the other threads in between the rounds */
+        thread_preempt();
+        x86_sti();
+    }
+}
+
+void tasklet_init(tasklet_t *t, tasklet_func_t func, void *arg)
+{
+    *t = (tasklet_t)TASKLET_INITIAL_VALUE(func, arg);
+}
+
+static void tasklet_queue(tasklet_t *t, uint32_t hi)
+{
+    if (__atomic_fetch_or(&t->state, TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL) &
+        TASKLET_STATE_SCHED) {
+        return;
+    }
+
+    softirq_cpu_t *sc = this_cpu_ptr(softirq_cpu);
+    uint64_t       flags = x86_save_flags();
+    x86_cli();
+
+    list_add_tail(&sc->tasklets[hi], &t->node);
+    softirq_mark(sc, hi ? SOFTIRQ_HI_TASKLET : SOFTIRQ_TASKLET, flags);
+
+    x86_restore_flags(flags);
+}
+
+void tasklet_schedule(tasklet_t *t)
+{
+    tasklet_queue(t, 0);
+}
+
+void tasklet_hi_schedule(tasklet_t *t)
+{
+    tasklet_queue(t, 1);
+}
+
+static void tasklet_run(uint32_t hi)
+{
+    softirq_cpu_t *sc = this_cpu_ptr(softirq_cpu);
+    list_t         list;
+
+    x86_cli();
+    list_move(&sc->tasklets[hi], &list);
+    x86_sti();
+
+    tasklet_t *t;
+    while ((t = list_remove_head_type(&list, tasklet_t, node))) {
+        /* still running on another CPU, try again later */
+        if (__atomic_fetch_or(&t->state, TASKLET_STATE_RUN,
+                              __ATOMIC_ACQUIRE) &
+            TASKLET_STATE_RUN) {
+            x86_cli();
+            list_add_tail(&sc->tasklets[hi], &t->node);
+            softirq_raise(hi ? SOFTIRQ_HI_TASKLET : SOFTIRQ_TASKLET);
+            x86_sti();
+            continue;
+        }
+
+        /* it may be scheduled again from here on */
+        __atomic_fetch_and(&t->state, ~TASKLET_STATE_SCHED, __ATOMIC_ACQ_REL);
+        t->func(t->arg);
+        __atomic_fetch_and(&t->state, ~TASKLET_STATE_RUN, __ATOMIC_RELEASE);
+    }
+}
+
+static void tasklet_softirq(void)
+{
+    tasklet_run(0);
+}
+
+static void tasklet_hi_softirq(void)
+{
+    tasklet_run(1);
+}
+
+static void softirq_percpu_init(const void *arg)
+{
+    softirq_cpu_t *sc = this_cpu_ptr(softirq_cpu);
+
+    list_init(&sc->tasklets[0]);
+    list_init(&sc->tasklets[1]);
+
+    softirq_register(SOFTIRQ_TASKLET, tasklet_softirq);
+    softirq_register(SOFTIRQ_HI_TASKLET, tasklet_hi_softirq);
+
+    sc->thread = thread_create((uint8_t *)"ksoftirqd", ksoftirqd, NULL,
+                               DEFAULT_PRIORITY, NULL, 0);
+    if (sc->thread) {
+        thread_detach(sc->thread);
+    }
+}
+
+REGISTER_INIT_HOOK(softirq, PERCPU, 3, &softirq_percpu_init, NULL);
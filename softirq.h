@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <list.h>
+
+/**
+ * Deferred interrupt work. Interrupt handlers do the minimum in hard
+ * interrupt context and raise a softirq, whose handler runs on the same CPU
+ * with interrupts enabled on the way out of the outermost interrupt. Work
+ * that keeps coming back is handed to the per-CPU ksoftirqd thread so it
+ * competes with the other threads instead of starving them.
+ *
+ * Lower numbers run first.
+ */
+typedef enum softirq_nr {
+    SOFTIRQ_HI_TASKLET, /* High priority tasklets. */
+    SOFTIRQ_TIMER,      /* Timer expiry. */
+    SOFTIRQ_TASKLET,    /* Tasklets. */
+    NUM_SOFTIRQS,
+} softirq_nr_t;
+
+typedef void (*softirq_handler_t)(void);
+
+/**
+ * Installs the handler of a softirq. Handlers run with interrupts enabled,
+ * never nested and never concurrently on the same CPU, and must not block.
+ */
+void softirq_register(softirq_nr_t nr, softirq_handler_t handler);
+
+/**
+ * Marks the softirq pending on the current CPU. Raised in interrupt context
+ * it runs on the way out of the interrupt, raised from a thread with
+ * interrupts enabled it wakes the CPU's ksoftirqd.
+ */
+void softirq_raise(softirq_nr_t nr);
+
+/**
+ * Runs the pending softirqs. Called with interrupts disabled on the way out
+ * of the outermost interrupt.
+ */
+void softirq_irq_exit(void);
+
+/**
+ * Whether the current CPU is running softirq handlers. Threads are not
+ * switched under them.
+ */
+bool softirq_active(void);
+
+typedef struct tasklet tasklet_t;
+
+typedef void (*tasklet_func_t)(void *arg);
+
+/**
+ * A function deferred from an interrupt handler. A tasklet is queued at
+ * most once and never runs on two CPUs at a time.
+ */
+struct tasklet {
+    list_node_t    node;
+    tasklet_func_t func;
+    void          *arg;
+    uint32_t       state;
+};
+
+#define TASKLET_INITIAL_VALUE(_func, _arg)                                     \
+    {                                                                          \
+        .node = LIST_INITIAL_CLEARED_VALUE, .func = (_func), .arg = (_arg),    \
+        .state = 0,                                                            \
+    }
+
+void tasklet_init(tasklet_t *t, tasklet_func_t func, void *arg);
+
+/**
+ * Queues the tasklet on the current CPU unless it is already queued.
+ */
+void tasklet_schedule(tasklet_t *t);
+
+/**
+ * Same as tasklet_schedule() ahead of the timers and normal tasklets.
+ */
+void tasklet_hi_schedule(tasklet_t *t);
@@ -2,6 +2,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <x86.h>
 
 typedef size_t spin_lock_t;
 
@@ -12,15 +14,43 @@ static inline void spin_lock_init(spin_lock_t *lock)
 
 static inline void spin_lock_lock(spin_lock_t *lock)
 {
-    *lock = 1;
+    while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+        /* spin on a plain load so the cache line stays shared */
+        while (__atomic_load_n(lock, __ATOMIC_RELAXED)) {
+            x86_pause();
+        }
+    }
+}
+
+static inline bool spin_lock_trylock(spin_lock_t *lock)
+{
+    return !__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);
 }
 
 static inline bool spin_lock_held(spin_lock_t *lock)
 {
-    return (!(*lock));
+    return __atomic_load_n(lock, __ATOMIC_RELAXED) != 0;
 }
 
-static inline bool spin_lock_unlock(spin_lock_t *lock)
+static inline void spin_lock_unlock(spin_lock_t *lock)
 {
-    *lock = 0;
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Disables interrupts on the local CPU before taking the lock. Must be used
+ * for locks that are also taken from interrupt handlers.
+ */
+static inline void spin_lock_lock_irqsave(spin_lock_t *lock, uint64_t *flags)
+{
+    *flags = x86_save_flags();
+    x86_cli();
+    spin_lock_lock(lock);
+}
+
+static inline void spin_lock_unlock_irqrestore(spin_lock_t *lock,
+                                               uint64_t    flags)
+{
+    spin_lock_unlock(lock);
+    x86_restore_flags(flags);
 }
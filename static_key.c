@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <static_key.h>
+#include <smp.h>
+#include <string.h>
+#include <x86.h>
+
+#define JUMP_OPCODE 0xe9
+
+static const uint8_t jump_label_nop[JUMP_LABEL_SIZE] = {0x0f, 0x1f, 0x44,
+                                                        0x00, 0x00};
+
+typedef struct static_key_update {
+    static_key_t *key;
+    bool          enable;
+} static_key_update_t;
+
+static void jump_label_patch(const jump_entry_t *entry, bool enable)
+{
+    volatile uint8_t *code = (volatile uint8_t *)entry->code;
+    uint8_t           insn[JUMP_LABEL_SIZE];
+
+    if (enable) {
+        int32_t rel = entry->target - (entry->code + JUMP_LABEL_SIZE);
+
+        insn[0] = JUMP_OPCODE;
+        memcpy(&insn[1], &rel, sizeof(rel));
+    }
+    else {
+        memcpy(insn, jump_label_nop, sizeof(insn));
+    }
+
+    /* kernel text is mapped writable, nothing else runs it right now */
+    for (uint32_t i = 0; i < JUMP_LABEL_SIZE; ++i) {
+        code[i] = insn[i];
+    }
+}
+
+/* runs with every other CPU stopped */
+static void static_key_update(void *arg)
+{
+    static_key_update_t *update = arg;
+    uint32_t             eax, ebx, ecx, edx;
+
+    for (jump_entry_t *entry = __jump_table_start; entry < __jump_table_end;
+         ++entry) {
+        if (entry->key == (uint64_t)update->key) {
+            jump_label_patch(entry, update->enable);
+        }
+    }
+
+    __atomic_store_n(&update->key->enabled, update->enable, __ATOMIC_RELAXED);
+
+    /* cpuid serializes, the stale instructions may have been prefetched.
+     * The stopped CPUs serialize on the iretq out of the IPI. */
+    x86_cpuid(0, &eax, &ebx, &ecx, &edx);
+}
+
+static void static_key_set(static_key_t *key, bool enable)
+{
+    static_key_update_t update = {.key = key, .enable = enable};
+
+    if (static_key_enabled(key) == enable) {
+        return;
+    }
+
+    stop_machine(static_key_update, &update);
+}
+
+void static_key_enable(static_key_t *key)
+{
+    static_key_set(key, true);
+}
+
+void static_key_disable(static_key_t *key)
+{
+    static_key_set(key, false);
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <compiler.h>
+
+/* size of the patched instruction, a 5-byte NOP or a jmp rel32 */
+#define JUMP_LABEL_SIZE 5
+
+/**
+ * A switch tested on hot paths. Instead of loading a flag every test site
+ * is a NOP that falls through to the disabled path, enabling the key
+ * rewrites each site into a jump to the enabled path.
+ */
+typedef struct static_key {
+    bool enabled;
+} static_key_t;
+
+#define STATIC_KEY_INIT {.enabled = false}
+
+/**
+ * A test site, recorded in the ".jump_table" section.
+ */
+typedef struct jump_entry {
+    uint64_t code;   /* Address of the patched instruction. */
+    uint64_t target; /* Start of the enabled path. */
+    uint64_t key;    /* Key the site tests. */
+} jump_entry_t;
+
+/* kernel.lds.S */
+extern jump_entry_t __jump_table_start[];
+extern jump_entry_t __jump_table_end[];
+
+/**
+ * Tests a key that is expected to be disabled, costs a single NOP while it
+ * is. A macro rather than an inline function since the key address has to
+ * be a link time constant even without optimization.
+ *
+ * @param key Address of a static_key_t with static storage.
+ */
+#define static_key_unlikely(key)                                               \
+    ({                                                                         \
+        __label__ __sk_yes, __sk_out;                                          \
+        bool __sk_ret;                                                         \
+        __asm__ goto("1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"               \
+                     ".pushsection .jump_table, \"aw\"\n\t"                    \
+                     ".balign 8\n\t"                                           \
+                     ".quad 1b, %l[__sk_yes], %P0\n\t"                         \
+                     ".popsection"                                             \
+                     :                                                         \
+                     : "i"(key)                                                \
+                     :                                                         \
+                     : __sk_yes);                                              \
+        __sk_ret = false;                                                      \
+        goto __sk_out;                                                         \
+    __sk_yes:                                                                  \
+        __sk_ret = true;                                                       \
+    __sk_out:                                                                  \
+        __sk_ret;                                                              \
+    })
+
+static inline bool static_key_enabled(const static_key_t *key)
+{
+    return __atomic_load_n(&key->enabled, __ATOMIC_RELAXED);
+}
+
+/**
+ * Turns a key on by patching every site that tests it into a jump. The
+ * other CPUs are held in stop_machine() while the code changes under them.
+ * Must be called with interrupts enabled.
+ */
+void static_key_enable(static_key_t *key);
+
+/**
+ * Turns a key off by patching its sites back to NOPs.
+ */
+void static_key_disable(static_key_t *key);
@@ -13,3 +13,10 @@ typedef long long          int64_t;
 
 typedef unsigned long uintptr_t;
 typedef long          intptr_t;
+
+#define UINT8_MAX  0xff
+#define UINT16_MAX 0xffff
+#define UINT32_MAX 0xffffffffU
+#define UINT64_MAX 0xffffffffffffffffULL
+
+#define SIZE_MAX   0xffffffffffffffffUL
@@ -2,36 +2,166 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <init.h>
+#include <static_key.h>
+#include <x86.h>
+
+/* below this size rep movsb has too much startup cost without FSRM */
+#define REP_MOVSB_MIN 64
+
+/* unaligned quadword access, x86 handles it in hardware */
+typedef uint64_t __attribute__((may_alias, aligned(1))) unaligned_u64;
+
+/* rep movsb and rep stosb beat the loops below, selected at boot */
+static static_key_t string_erms = STATIC_KEY_INIT;
+static static_key_t string_fsrm = STATIC_KEY_INIT;
+
+/* copies this large would only evict the cache, they bypass it */
+static size_t memcpy_nt_threshold = SIZE_MAX;
+
+static inline void rep_movsb(void *dst, const void *src, size_t count)
+{
+    __asm__ volatile("rep movsb"
+                     : "+D"(dst), "+S"(src), "+c"(count)
+                     :
+                     : "memory");
+}
+
+static inline void rep_stosb(void *dst, uint8_t c, size_t count)
+{
+    __asm__ volatile("rep stosb"
+                     : "+D"(dst), "+c"(count)
+                     : "a"(c)
+                     : "memory");
+}
+
+static inline void movnti(void *dst, uint64_t val)
+{
+    __asm__ volatile("movnti %1, %0" : "=m"(*(uint64_t *)dst) : "r"(val));
+}
+
+static void copy_forward(uint8_t *dst, const uint8_t *src, size_t count)
+{
+    /* every block is loaded before it is stored, so this is also safe for
+     * memmove() with the destination below the source */
+    for (; count >= 32; count -= 32, dst += 32, src += 32) {
+        uint64_t a = ((const unaligned_u64 *)src)[0];
+        uint64_t b = ((const unaligned_u64 *)src)[1];
+        uint64_t c = ((const unaligned_u64 *)src)[2];
+        uint64_t d = ((const unaligned_u64 *)src)[3];
+
+        ((unaligned_u64 *)dst)[0] = a;
+        ((unaligned_u64 *)dst)[1] = b;
+        ((unaligned_u64 *)dst)[2] = c;
+        ((unaligned_u64 *)dst)[3] = d;
+    }
+
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        *(unaligned_u64 *)dst = *(const unaligned_u64 *)src;
+    }
+
+    for (; count > 0; count--) {
+        *dst++ = *src++;
+    }
+}
+
+static void copy_backward(uint8_t *dst, const uint8_t *src, size_t count)
+{
+    dst += count;
+    src += count;
+
+    for (; count >= 32; count -= 32) {
+        dst -= 32;
+        src -= 32;
+
+        uint64_t a = ((const unaligned_u64 *)src)[0];
+        uint64_t b = ((const unaligned_u64 *)src)[1];
+        uint64_t c = ((const unaligned_u64 *)src)[2];
+        uint64_t d = ((const unaligned_u64 *)src)[3];
+
+        ((unaligned_u64 *)dst)[3] = d;
+        ((unaligned_u64 *)dst)[2] = c;
+        ((unaligned_u64 *)dst)[1] = b;
+        ((unaligned_u64 *)dst)[0] = a;
+    }
+
+    for (; count >= 8; count -= 8) {
+        dst -= 8;
+        src -= 8;
+        *(unaligned_u64 *)dst = *(const unaligned_u64 *)src;
+    }
+
+    for (; count > 0; count--) {
+        *--dst = *--src;
+    }
+}
+
+/* streams the data past the cache, for copies larger than the LLC */
+static void copy_nontemporal(uint8_t *dst, const uint8_t *src, size_t count)
+{
+    /* movnti wants an aligned destination */
+    size_t head = (-(uintptr_t)dst) & 7;
+
+    copy_forward(dst, src, head);
+    dst += head;
+    src += head;
+    count -= head;
+
+    for (; count >= 32; count -= 32, dst += 32, src += 32) {
+        movnti(dst, ((const unaligned_u64 *)src)[0]);
+        movnti(dst + 8, ((const unaligned_u64 *)src)[1]);
+        movnti(dst + 16, ((const unaligned_u64 *)src)[2]);
+        movnti(dst + 24, ((const unaligned_u64 *)src)[3]);
+    }
+
+    /* the streaming stores are weakly ordered */
+    __asm__ volatile("sfence" ::: "memory");
+
+    copy_forward(dst, src, count);
+}
+
+static void copy_fast(uint8_t *dst, const uint8_t *src, size_t count)
+{
+    if (count >= memcpy_nt_threshold) {
+        copy_nontemporal(dst, src, count);
+    }
+    else if (static_key_unlikely(&string_fsrm) ||
+             (count >= REP_MOVSB_MIN && static_key_unlikely(&string_erms))) {
+        rep_movsb(dst, src, count);
+    }
+    else {
+        copy_forward(dst, src, count);
+    }
+}
 
 void *memset(void *dest, int c, size_t count)
 {
     uint8_t *dst = (uint8_t *)dest;
-    size_t   nabytes = (-(size_t)dest) & (sizeof(size_t) - 1);
-    size_t   val = c & 0xff;
+    uint64_t val = (uint8_t)c * 0x0101010101010101ULL;
 
-    /* if we have to set both aligned and non aligned bytes */
-    if (count > nabytes) {
-        count -= nabytes;
+    if (static_key_unlikely(&string_erms)) {
+        rep_stosb(dst, c, count);
+        return dest;
+    }
 
-        val |= val << 8;
-        val |= val << 16;
-        val |= val << 32;
+    /* set the non-aligned head byte-wise */
+    for (; count > 0 && ((uintptr_t)dst & 7); count--) {
+        *dst++ = c;
+    }
 
-        /* set the non-aligned bytes memory byte-wise */
-        for (; nabytes > 0; nabytes--) {
-            *dst++ = c;
-        }
+    for (; count >= 32; count -= 32, dst += 32) {
+        ((uint64_t *)dst)[0] = val;
+        ((uint64_t *)dst)[1] = val;
+        ((uint64_t *)dst)[2] = val;
+        ((uint64_t *)dst)[3] = val;
+    }
 
-        /* set the aligned bytes using dword */
-        size_t abytes = count / sizeof(size_t);
-        for (; abytes > 0; abytes--) {
-            *((size_t *)dst) = val;
-            dst += sizeof(size_t);
-        }
+    for (; count >= 8; count -= 8, dst += 8) {
+        *(uint64_t *)dst = val;
     }
 
     for (; count > 0; count--) {
-        *dst++ = val;
+        *dst++ = c;
     }
 
     return dest;
@@ -44,22 +174,110 @@ void *memchr(void const *ptr, int value, size_t count)
 
 int memcmp(void const *a, void const *b, size_t count)
 {
+    uint8_t const *s1 = (uint8_t const *)a;
+    uint8_t const *s2 = (uint8_t const *)b;
+
+    for (; count > 0; count--, s1++, s2++) {
+        if (*s1 != *s2) {
+            return *s1 - *s2;
+        }
+    }
+
     return 0;
 }
 
 void *memcpy(void *dest, void const *src, size_t count)
 {
-    uint8_t *dst = (uint8_t *)dest;
-    uint8_t *s = (uint8_t *)src;
+    copy_fast(dest, src, count);
+    return dest;
+}
 
-    for (; count > 0; count--) {
-        *(dst++) = *(s++);
+void *memmove(void *dest, void const *src, size_t count)
+{
+    /* only a destination inside the source has to be copied backwards */
+    if ((uintptr_t)dest - (uintptr_t)src >= count) {
+        copy_fast(dest, src, count);
+    }
+    else {
+        copy_backward(dest, src, count);
     }
 
     return dest;
 }
 
-void *memmove(void *dest, void const *src, size_t count)
+size_t strlen(const char *str)
 {
-    return NULL;
+    const char *s = str;
+    while (*s) {
+        s++;
+    }
+
+    return s - str;
+}
+
+int strcmp(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+
+    return *(const uint8_t *)a - *(const uint8_t *)b;
+}
+
+/* size of the last level cache, 0 if the CPU does not report it */
+static size_t string_llc_size(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    size_t   size = 0;
+
+    x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+
+    /* deterministic cache parameters, the last level comes last */
+    if (eax >= 0x4) {
+        for (uint32_t i = 0;; ++i) {
+            x86_cpuid_c(0x4, i, &eax, &ebx, &ecx, &edx);
+            if (!(eax & 0x1f)) {
+                break;
+            }
+
+            size = (size_t)((ebx >> 22) + 1) * (((ebx >> 12) & 0x3ff) + 1) *
+                   ((ebx & 0xfff) + 1) * ((size_t)ecx + 1);
+        }
+    }
+
+    /* AMD reports the L3 in 512 KiB units */
+    if (!size) {
+        x86_cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+        if (eax >= 0x80000006) {
+            x86_cpuid(0x80000006, &eax, &ebx, &ecx, &edx);
+            size = (size_t)(edx >> 18) * 512 * 1024;
+        }
+    }
+
+    return size;
+}
+
+static void string_init(const void *arg)
+{
+    uint32_t eax, ebx, ecx, edx;
+    size_t   llc = string_llc_size();
+
+    x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0x7) {
+        x86_cpuid_c(0x7, 0, &eax, &ebx, &ecx, &edx);
+
+        if (ebx & X86_CPUID_7_EBX_ERMS) {
+            static_key_enable(&string_erms);
+        }
+        if (edx & X86_CPUID_7_EDX_FSRM) {
+            static_key_enable(&string_fsrm);
+        }
+    }
+
+    if (llc) {
+        memcpy_nt_threshold = llc;
+    }
 }
+
+REGISTER_INIT_HOOK(string, ARCH, 1, &string_init, NULL);
@@ -9,3 +9,6 @@ int   memcmp(void const *a, void const *b, size_t count) __pure;
 void *memset(void *dest, int c, size_t count);
 void *memcpy(void *dest, void const *src, size_t count);
 void *memmove(void *dest, void const *src, size_t count);
+
+size_t strlen(const char *str) __pure;
+int    strcmp(const char *a, const char *b) __pure;
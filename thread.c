@@ -1,35 +1,534 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <thread.h>
+#include <scheduler.h>
 #include <spinlock.h>
 #include <cpu_data.h>
+#include <apic.h>
+#include <clock.h>
+#include <counters.h>
+#include <init.h>
+#include <platform.h>
+#include <string.h>
+#include <trace.h>
+#include <workqueue.h>
 
-list_t      thread_list;
+/* cswitch.S */
+extern void cswitch(vaddr_t *old_sp, vaddr_t *new_sp);
+
+list_t      thread_list = LIST_INITIAL_VALUE(thread_list);
 uint32_t    thread_count;
 spin_lock_t thread_lock = 0;
 
-static queue_t  thread_queue;
-static uint32_t thread_queue_bitmap;
+/**
+ * Per-CPU run queue with a FIFO for each priority. Threads stay on the CPU
+ * they were created on.
+ */
+typedef struct run_queue {
+    spin_lock_t lock;
+    uint32_t    bitmap; /* Priorities with a non-empty queue. */
+    list_t      queues[NUM_PRIORITIES];
+
+    bool     need_resched;  /* Switch threads on interrupt exit. */
+    timer_t  preempt_timer; /* Time slice, armed only under competition. */
+    thread_t *dead;         /* Exited thread to reap after the switch. */
+} run_queue_t;
+
+DEFINE_PER_CPU(run_queue_t, run_queue);
+
+DEFINE_COUNTER(context_switches, "context switches");
+
+static inline bool thread_is_idle(thread_t *t)
+{
+    return t->flags & THREAD_FLAG_IDLE;
+}
+
+/* run queue lock held */
+static void run_queue_insert(run_queue_t *rq, thread_t *t)
+{
+    t->state = THREAD_STATE_READY;
+    list_add_tail(&rq->queues[t->priority], &t->queue_node);
+    rq->bitmap |= 1U << t->priority;
+}
+
+/* run queue lock held */
+static int run_queue_top_priority(run_queue_t *rq)
+{
+    return rq->bitmap ? 31 - __builtin_clz(rq->bitmap) : -1;
+}
+
+/* run queue lock held */
+static thread_t *run_queue_pop(run_queue_t *rq)
+{
+    int prio = run_queue_top_priority(rq);
+    if (prio < 0) {
+        return NULL;
+    }
+
+    thread_t *t =
+        list_remove_head_type(&rq->queues[prio], thread_t, queue_node);
+    if (list_is_empty(&rq->queues[prio])) {
+        rq->bitmap &= ~(1U << prio);
+    }
+
+    return t;
+}
+
+static void thread_preempt_timer(timer_t *timer, void *arg)
+{
+    this_cpu_ptr(run_queue)->need_resched = true;
+}
+
+/*
+ * A thread alone on its CPU runs without a tick, the time slice timer is
+ * only armed once another thread is waiting. Run queue lock held.
+ */
+static void thread_arm_quantum(run_queue_t *rq, thread_t *cur)
+{
+    if (!thread_is_idle(cur) && rq->bitmap && !rq->preempt_timer.active) {
+        timer_set_oneshot(&rq->preempt_timer, THREAD_QUANTUM_NS,
+                          thread_preempt_timer, NULL);
+    }
+}
+
+static void thread_free(thread_t *t)
+{
+    if (t->flags & THREAD_FLAG_FREE_STACK) {
+        pmm_free_kpages(t->stack, t->stack_size / PAGE_SIZE);
+    }
+    if (t->flags & THREAD_FLAG_FREE_STRUCT) {
+        pmm_free_kpages(t, 1);
+    }
+}
+
+/* the exited thread is off its stack, free it or hand it to its joiner */
+static void thread_reap(thread_t *t)
+{
+    spin_lock_lock(&thread_lock);
+
+    t->flags |= THREAD_FLAG_EXITED;
+
+    if (t->flags & THREAD_FLAG_DETACHED) {
+        list_delete(&t->thread_list);
+        spin_lock_unlock(&thread_lock);
+        thread_free(t);
+        return;
+    }
+
+    /* the joiner cannot give up waiting while the lock is held */
+    if (t->joiner) {
+        thread_unblock(t->joiner);
+    }
+
+    spin_lock_unlock(&thread_lock);
+}
+
+/* runs on the new thread's stack right after every switch */
+static void thread_finish_switch(void)
+{
+    run_queue_t *rq = this_cpu_ptr(run_queue);
+
+    if (rq->dead) {
+        thread_t *dead = rq->dead;
+        rq->dead = NULL;
+        thread_reap(dead);
+    }
+}
+
+void thread_reschedule(void)
+{
+    run_queue_t *rq = this_cpu_ptr(run_queue);
+    cpu_data_t  *cpu = get_current_cpu_data();
+    thread_t    *cur = get_current_thread();
+
+    /* a worker blocking inside a work item lets another worker run */
+    if (cur->state == THREAD_STATE_WAITING &&
+        (cur->flags & THREAD_FLAG_WORKER)) {
+        workqueue_worker_sleeping(cur);
+    }
+
+    spin_lock_lock(&rq->lock);
+    rq->need_resched = false;
+
+    /* a preempted or yielding thread goes to the back of its queue */
+    if (cur->state == THREAD_STATE_RUNNING && !thread_is_idle(cur)) {
+        run_queue_insert(rq, cur);
+    }
+
+    thread_t *next = run_queue_pop(rq);
+    if (!next) {
+        next = &cpu->cpu_processor->idle_thread;
+    }
+
+    /* every thread starts with a fresh time slice */
+    timer_cancel(&rq->preempt_timer);
+    thread_arm_quantum(rq, next);
+
+    spin_lock_unlock(&rq->lock);
+
+    next->state = THREAD_STATE_RUNNING;
+    if (next == cur) {
+        goto out;
+    }
+
+    cpu->cpu_current_thread = next;
+    cpu->cpu_processor->current_thread = next;
+    cpu->cpu_processor->state =
+        thread_is_idle(next) ? PROCESSOR_STATE_IDLE : PROCESSOR_STATE_RUNNING;
+
+    counter_inc(context_switches);
+    TRACEPOINT(sched_switch, "%llx -> %llx prio %lld", cur, next,
+               (int64_t)next->priority);
+
+    cswitch(&cur->sp, &next->sp);
+
+    thread_finish_switch();
+
+out:
+    if (cur->flags & THREAD_FLAG_WORKER) {
+        workqueue_worker_running(cur);
+    }
+}
+
+void thread_preempt(void)
+{
+    if (this_cpu_ptr(run_queue)->need_resched) {
+        thread_reschedule();
+    }
+}
+
+void thread_yield(void)
+{
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    thread_reschedule();
+
+    x86_restore_flags(flags);
+}
+
+void thread_block(void)
+{
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    get_current_thread()->state = THREAD_STATE_WAITING;
+    thread_reschedule();
+
+    x86_restore_flags(flags);
+}
+
+void thread_unblock(thread_t *t)
+{
+    run_queue_t *rq = per_cpu_ptr(run_queue, t->cpu);
+    uint64_t     flags;
+
+    spin_lock_lock_irqsave(&rq->lock, &flags);
+
+    if (t->state != THREAD_STATE_WAITING &&
+        t->state != THREAD_STATE_SUSPENDED) {
+        spin_lock_unlock_irqrestore(&rq->lock, flags);
+        return;
+    }
+
+    run_queue_insert(rq, t);
+
+    bool local = t->cpu == get_current_cpu_number();
+    if (local) {
+        thread_t *cur = get_current_thread();
+
+        if (thread_is_idle(cur) || t->priority > cur->priority) {
+            rq->need_resched = true;
+        }
+        else {
+            thread_arm_quantum(rq, cur);
+        }
+    }
+
+    spin_lock_unlock(&rq->lock);
+
+    /* let the other CPU decide whether to preempt its thread */
+    if (!local) {
+        lapic_send_ipi_fixed(get_cpu_data(t->cpu)->cpu_lapic_id,
+                             IPI_RESCHEDULE_VECTOR);
+    }
+
+    x86_restore_flags(flags);
+}
+
+static void thread_resched_ipi(void *arg)
+{
+    run_queue_t *rq = this_cpu_ptr(run_queue);
+    thread_t    *cur = get_current_thread();
+
+    spin_lock_lock(&rq->lock);
+
+    if (rq->bitmap && (thread_is_idle(cur) ||
+                       run_queue_top_priority(rq) > cur->priority)) {
+        rq->need_resched = true;
+    }
+    else {
+        thread_arm_quantum(rq, cur);
+    }
+
+    spin_lock_unlock(&rq->lock);
+}
+
+static void thread_start(void) __noreturn;
+static void thread_start(void)
+{
+    thread_finish_switch();
+    x86_sti();
+
+    thread_t *t = get_current_thread();
+    t->func(t->arg);
+
+    thread_exit(0);
+}
+
+/* builds the frame cswitch() pops when the thread first runs */
+static void thread_init_stack(thread_t *t)
+{
+    uint64_t *sp =
+        (uint64_t *)ROUND_DOWN((uintptr_t)t->stack + t->stack_size, 16);
+
+    *--sp = 0;                      /* return address of thread_start */
+    *--sp = (uint64_t)thread_start; /* cswitch returns here */
+    for (int i = 0; i < 6; ++i) {
+        *--sp = 0;                  /* rbp, rbx, r12 - r15 */
+    }
+
+    t->sp = (vaddr_t)sp;
+}
+
+thread_t *thread_create_on(uint32_t cpu, uint8_t *name, thread_func_t func,
+                           void *arg, int priority, void *stack,
+                           size_t stack_size, uint32_t flags)
+{
+    thread_t *t = pmm_alloc_kpages(1, NULL);
+    if (!t) {
+        return NULL;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->flags = THREAD_FLAG_FREE_STRUCT | flags;
+
+    if (!stack) {
+        stack = pmm_alloc_kpages(1, NULL);
+        if (!stack) {
+            pmm_free_kpages(t, 1);
+            return NULL;
+        }
+        stack_size = DEFAULT_STACK_SIZE;
+        t->flags |= THREAD_FLAG_FREE_STACK;
+    }
+
+    size_t len = strlen((const char *)name);
+    if (len > sizeof(t->name) - 1) {
+        len = sizeof(t->name) - 1;
+    }
+    memcpy(t->name, name, len);
+
+    if (priority < LOWEST_PRIORITY + 1) {
+        priority = LOWEST_PRIORITY + 1; /* below that only idles */
+    }
+    else if (priority > HIGHEST_PRIORITY) {
+        priority = HIGHEST_PRIORITY;
+    }
+
+    t->priority = priority;
+    t->func = func;
+    t->arg = arg;
+    t->stack = stack;
+    t->stack_size = stack_size;
+    t->cpu = cpu;
+    t->state = THREAD_STATE_SUSPENDED;
+    timer_init(&t->sleep_timer);
+    thread_init_stack(t);
+
+    uint64_t irqflags;
+    spin_lock_lock_irqsave(&thread_lock, &irqflags);
+    t->id = thread_count++;
+    list_add(&thread_list, &t->thread_list);
+    spin_lock_unlock_irqrestore(&thread_lock, irqflags);
+
+    return t;
+}
+
+thread_t *thread_create(uint8_t *name, thread_func_t func, void *arg,
+                        int priority, void *stack, size_t stack_size)
+{
+    thread_t *t = thread_create_on(get_current_cpu_number(), name, func, arg,
+                                   priority, stack, stack_size, 0);
+    if (t) {
+        thread_unblock(t);
+    }
+    return t;
+}
+
+void thread_exit(int ret)
+{
+    thread_t *cur = get_current_thread();
+
+    x86_cli();
+
+    timer_cancel(&cur->sleep_timer);
+
+    cur->ret = ret;
+    cur->state = THREAD_STATE_DEAD;
+
+    /* the next thread reaps us once we are off our stack */
+    this_cpu_ptr(run_queue)->dead = cur;
+    thread_reschedule();
+
+    unreachable();
+}
+
+static void thread_sleep_wakeup(timer_t *timer, void *arg)
+{
+    thread_unblock(arg);
+}
+
+void thread_sleep(uint64_t ms)
+{
+    thread_t *cur = get_current_thread();
+    uint64_t  flags = x86_save_flags();
+    x86_cli();
+
+    /* the timer is local and interrupts are off, it cannot fire before we
+     * are switched out */
+    timer_set_oneshot(&cur->sleep_timer, ms * NSEC_PER_MSEC,
+                      thread_sleep_wakeup, cur);
+    cur->state = THREAD_STATE_WAITING;
+    thread_reschedule();
+
+    x86_restore_flags(flags);
+}
 
 void thread_init_early(void)
 {
     list_init(&thread_list);
-    boot_cpu_init();
 
     thread_t *t = &get_cpu_data(0)->cpu_processor->idle_thread;
     create_bootstrap_thread(t);
 }
 
-static void thread_queue_enqueue(thread_t *t)
+bool thread_join(thread_t *t, int *retcode, uint64_t timeout)
 {
+    thread_t *cur = get_current_thread();
+    uint64_t  flags = x86_save_flags();
+    x86_cli();
+
+    spin_lock_lock(&thread_lock);
+
+    if ((t->flags & THREAD_FLAG_DETACHED) || t->joiner) {
+        spin_lock_unlock(&thread_lock);
+        x86_restore_flags(flags);
+        return false;
+    }
+
+    if (!(t->flags & THREAD_FLAG_EXITED) && timeout) {
+        t->joiner = cur;
+        if (timeout != INFINITE_TIME) {
+            timer_set_oneshot(&cur->sleep_timer, timeout * NSEC_PER_MSEC,
+                              thread_sleep_wakeup, cur);
+        }
+
+        /* woken by thread_reap() or the timeout */
+        cur->state = THREAD_STATE_WAITING;
+        spin_lock_unlock(&thread_lock);
+        thread_reschedule();
+
+        timer_cancel(&cur->sleep_timer);
+        spin_lock_lock(&thread_lock);
+        t->joiner = NULL;
+    }
+
+    if (!(t->flags & THREAD_FLAG_EXITED)) {
+        spin_lock_unlock(&thread_lock);
+        x86_restore_flags(flags);
+        return false;
+    }
+
+    list_delete(&t->thread_list);
+    spin_lock_unlock(&thread_lock);
+
+    if (retcode) {
+        *retcode = t->ret;
+    }
+    thread_free(t);
+
+    x86_restore_flags(flags);
+    return true;
 }
 
-void thread_join(thread_t *t, uint64_t timeout)
+void thread_detach(thread_t *t)
 {
+    uint64_t flags;
+    spin_lock_lock_irqsave(&thread_lock, &flags);
+
+    /* already gone, nobody else frees it */
+    if (t->flags & THREAD_FLAG_EXITED) {
+        list_delete(&t->thread_list);
+        spin_lock_unlock_irqrestore(&thread_lock, flags);
+        thread_free(t);
+        return;
+    }
+
+    t->flags |= THREAD_FLAG_DETACHED;
+    spin_lock_unlock_irqrestore(&thread_lock, flags);
 }
 
 void create_bootstrap_thread(thread_t *t)
 {
     uint32_t cpu_num = get_current_cpu_number();
+
+    memset(t, 0, sizeof(*t));
+    memcpy(t->name, "idle", sizeof("idle"));
+    t->state = THREAD_STATE_RUNNING;
+    t->flags = THREAD_FLAG_IDLE;
+    t->priority = IDLE_PRIORITY;
+    t->cpu = cpu_num;
+    t->stack_size = 0;
+    timer_init(&t->sleep_timer);
+
+    spin_lock_lock(&thread_lock);
+    t->id = thread_count++;
     list_add(&thread_list, &t->thread_list);
+    spin_lock_unlock(&thread_lock);
+
+    processor_t *processor = get_cpu_data(cpu_num)->cpu_processor;
+    processor->current_thread = t;
+}
+
+void thread_idle_loop(void)
+{
+    run_queue_t *rq = this_cpu_ptr(run_queue);
+
+    get_current_cpu_data()->cpu_processor->state = PROCESSOR_STATE_IDLE;
+
+    for (;;) {
+        x86_cli();
+        if (rq->bitmap) {
+            thread_reschedule();
+        }
+
+        /* no tick is armed, sleep until the next event */
+        x86_safe_halt();
+    }
 }
+
+static void scheduler_percpu_init(const void *arg)
+{
+    run_queue_t *rq = this_cpu_ptr(run_queue);
+
+    spin_lock_init(&rq->lock);
+    for (uint32_t prio = 0; prio < NUM_PRIORITIES; ++prio) {
+        list_init(&rq->queues[prio]);
+    }
+    timer_init(&rq->preempt_timer);
+
+    register_isr(IPI_RESCHEDULE_VECTOR, thread_resched_ipi, true);
+}
+
+REGISTER_INIT_HOOK(scheduler, PERCPU, 2, &scheduler_percpu_init, NULL);
@@ -3,8 +3,12 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <list.h>
 #include <compiler.h>
+#include <timer.h>
+#include <types.h>
+#include <pmm.h>
 
 typedef struct processor_set processor_set_t;
 
@@ -13,10 +17,33 @@ typedef void (*thread_func_t)(void *arg);
 
 typedef enum thread_state {
     THREAD_STATE_SUSPENDED,
-    THREAD_STATE_WAITING,
+    THREAD_STATE_READY,   /* Queued on a run queue. */
+    THREAD_STATE_WAITING, /* Blocked until thread_unblock(). */
     THREAD_STATE_RUNNING,
+    THREAD_STATE_DEAD,    /* Exited, waiting to be freed. */
 } thread_state_t;
 
+#define NUM_PRIORITIES          32
+#define LOWEST_PRIORITY         0
+#define HIGHEST_PRIORITY        (NUM_PRIORITIES - 1)
+#define IDLE_PRIORITY           LOWEST_PRIORITY
+#define DEFAULT_PRIORITY        (NUM_PRIORITIES / 2)
+
+#define DEFAULT_STACK_SIZE      PAGE_SIZE
+
+/* Time a thread runs before others of the same priority get the CPU */
+#define THREAD_QUANTUM_NS       10000000
+
+#define THREAD_FLAG_FREE_STACK  (1 << 0) /* Stack allocated by thread_create */
+#define THREAD_FLAG_FREE_STRUCT (1 << 1) /* Allocated by thread_create */
+#define THREAD_FLAG_IDLE        (1 << 2) /* Idle thread of a processor */
+#define THREAD_FLAG_DETACHED    (1 << 3) /* Freed on exit, not joinable */
+#define THREAD_FLAG_EXITED      (1 << 4) /* Switched out for good */
+#define THREAD_FLAG_WORKER      (1 << 5) /* Workqueue worker */
+
+/* Timeout that never expires */
+#define INFINITE_TIME           UINT64_MAX
+
 typedef struct thread {
     thread_id_t id;          /* Thread ID */
     list_node_t thread_list; /* Thread list */
@@ -24,6 +51,16 @@ typedef struct thread {
     int         priority;    /* Thread priority*/
 
     thread_state_t state;    /* Current thread state */
+    uint32_t       flags;
+
+    list_node_t queue_node;  /* Run queue */
+    uint32_t    cpu;         /* CPU the thread runs on */
+    vaddr_t     sp;          /* Saved stack pointer while switched out */
+
+    timer_t sleep_timer;     /* Wakes the thread from thread_sleep() */
+    int     ret;             /* Return code passed to thread_exit() */
+
+    struct thread *joiner;   /* Thread waiting in thread_join() */
 
     processor_set_t *pset;   /* Processor set this thread
                               * was assigned.
@@ -65,23 +102,48 @@ void thread_sleep(uint64_t ms);
  *
  * @param stack_size Size of the thread stack.
  *
- * @return Pointer to the thread object or NULL on failure.
+ * @return Pointer to the thread object or NULL on failure. The thread is
+ * joinable until it is passed to thread_detach().
  */
 thread_t *thread_create(uint8_t *name, thread_func_t func, void *arg,
                         int priority, void *stack, size_t stack_size);
 
+/**
+ * Same as thread_create() for the specified CPU, except that the thread
+ * stays suspended until it is passed to thread_unblock().
+ *
+ * @param cpu CPU the thread runs on.
+ *
+ * @param flags Additional THREAD_FLAG_* flags.
+ */
+thread_t *thread_create_on(uint32_t cpu, uint8_t *name, thread_func_t func,
+                           void *arg, int priority, void *stack,
+                           size_t stack_size, uint32_t flags);
+
 /**
  * Sends the caller thread the waiting state and remains
  * waiting until the specified thread terminates.
  *
  * In case of timeout the control returns to the caller thread
  * whether or not the specified thread has completed execution.
+ * Only one thread may wait for a given thread at a time.
  *
  * @param t Thread to wait for to continue execution.
  *
- * @param timeout Time to wait for the specified thread to finish.
+ * @param retcode Receives the return code of the thread, may be NULL.
+ *
+ * @param timeout Time (in milliseconds) to wait for the specified thread
+ * to finish, 0 to poll or INFINITE_TIME.
+ *
+ * @return true if the thread terminated, it has been freed then.
+ */
+bool thread_join(thread_t *t, int *retcode, uint64_t timeout);
+
+/**
+ * Lets the thread be freed as soon as it terminates. It must not be joined
+ * afterwards.
  */
-void thread_join(thread_t *t, uint64_t timeout);
+void thread_detach(thread_t *t);
 
 /**
  * Terminates the current thread and returns the specified
@@ -95,3 +157,8 @@ void thread_exit(int ret) __noreturn;
  * Create initial thread responsible for booting up the system.
  */
 void create_bootstrap_thread(thread_t *t);
+
+/**
+ * Idle loop of the current processor. Halts until the next interrupt.
+ */
+void thread_idle_loop(void) __noreturn;
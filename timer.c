@@ -0,0 +1,357 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <timer.h>
+#include <apic.h>
+#include <clock.h>
+#include <cpu_data.h>
+#include <init.h>
+#include <percpu.h>
+#include <platform.h>
+#include <softirq.h>
+#include <spinlock.h>
+#include <stdlib.h>
+
+/* the wheel has four levels of 64 slots, each slot of a level spans a full
+ * turn of the level below */
+#define TIMER_WHEEL_BITS   6
+#define TIMER_WHEEL_SLOTS  (1U << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS 4
+
+/* wheel granularity, anything due sooner takes the high resolution path */
+#define TIMER_TICK_NS      NSEC_PER_MSEC
+
+/* ticks covered by one slot of the level */
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+#define LEVEL_TICKS(level) (1ULL << LEVEL_SHIFT(level))
+
+/* timeouts beyond the last level (about 4.6 hours) are clamped to it and
+ * cascade again once they get there */
+#define TIMER_WHEEL_RANGE  LEVEL_TICKS(TIMER_WHEEL_LEVELS)
+
+#define TIMER_NO_EVENT     UINT64_MAX
+
+/**
+ * Timers of a CPU. The wheel has processed every tick before clk. A slot
+ * of level 0 holds the timers expiring at one tick, a slot of a higher level
+ * is cascaded into the levels below when the wheel reaches its first tick.
+ */
+typedef struct timer_base {
+    spin_lock_t lock;
+    list_t      hres; /* High resolution timers sorted by deadline. */
+    uint64_t    clk;  /* Next tick to process. */
+    uint64_t    pending[TIMER_WHEEL_LEVELS]; /* Non-empty slots. */
+    list_t      wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+    uint64_t next_event; /* Time the local APIC timer is armed for. */
+    bool     in_expiry;  /* Callbacks are running. */
+} timer_base_t;
+
+DEFINE_PER_CPU(timer_base_t, timer_base);
+
+static inline uint64_t ror64(uint64_t val, uint32_t shift)
+{
+    return shift ? (val >> shift) | (val << (64 - shift)) : val;
+}
+
+/* base lock held */
+static void wheel_insert(timer_base_t *base, timer_t *timer)
+{
+    /* round up, a wheel timer never fires early */
+    uint64_t expires = (timer->deadline + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+    if (expires < base->clk) {
+        expires = base->clk;
+    }
+    else if (expires - base->clk >= TIMER_WHEEL_RANGE) {
+        expires = base->clk + TIMER_WHEEL_RANGE - 1;
+    }
+
+    uint64_t delta = expires - base->clk;
+    uint32_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= LEVEL_TICKS(level + 1)) {
+        level++;
+    }
+
+    uint32_t slot = (expires >> LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+
+    list_add_tail(&base->wheel[level][slot], &timer->node);
+    base->pending[level] |= 1ULL << slot;
+    timer->level = level;
+    timer->slot = slot;
+    timer->hres = false;
+}
+
+/* base lock held */
+static void wheel_remove(timer_base_t *base, timer_t *timer)
+{
+    list_delete(&timer->node);
+
+    if (list_is_empty(&base->wheel[timer->level][timer->slot])) {
+        base->pending[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+/* base lock held */
+static void hres_insert(timer_base_t *base, timer_t *timer)
+{
+    /* insert sorted, behind the timers with the same deadline */
+    timer_t *entry;
+    list_for_each_entry (entry, &base->hres, node) {
+        if (entry->deadline > timer->deadline) {
+            break;
+        }
+    }
+    list_add_tail(&entry->node, &timer->node);
+    timer->hres = true;
+}
+
+/*
+ * First tick at which the wheel has work to do, either expire a level 0
+ * slot or cascade a slot of a higher level. Base lock held.
+ */
+static uint64_t wheel_next_tick(timer_base_t *base)
+{
+    uint64_t next = TIMER_NO_EVENT;
+
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (!base->pending[level]) {
+            continue;
+        }
+
+        /* the next slot boundary of the level and the slot it starts */
+        uint64_t start = ROUND_UP(base->clk, LEVEL_TICKS(level));
+        uint32_t slot = (start >> LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+
+        /* distance in slots to the next non-empty one */
+        uint32_t dist = __builtin_ctzll(ror64(base->pending[level], slot));
+        uint64_t tick = start + dist * LEVEL_TICKS(level);
+
+        if (tick < next) {
+            next = tick;
+        }
+    }
+
+    return next;
+}
+
+/* moves the timers of a slot down the wheel, base lock held */
+static void wheel_cascade(timer_base_t *base, uint32_t level, uint32_t slot)
+{
+    list_t timers;
+    list_move(&base->wheel[level][slot], &timers);
+    base->pending[level] &= ~(1ULL << slot);
+
+    timer_t *timer;
+    while ((timer = list_remove_head_type(&timers, timer_t, node))) {
+        wheel_insert(base, timer);
+    }
+}
+
+/*
+ * Advances the wheel up to and including now, collecting the expired
+ * timers. Ticks without work are skipped in one go. Base lock held.
+ */
+static void wheel_advance(timer_base_t *base, uint64_t now, list_t *expired)
+{
+    while (base->clk <= now) {
+        uint64_t next = wheel_next_tick(base);
+        if (next > now) {
+            base->clk = now + 1;
+            break;
+        }
+        base->clk = next;
+
+        /* cascade the higher levels whose slot starts at this tick, the
+         * highest first */
+        uint32_t top = 0;
+        while (top < TIMER_WHEEL_LEVELS - 1 &&
+               !(base->clk & (LEVEL_TICKS(top + 1) - 1))) {
+            top++;
+        }
+        for (uint32_t level = top; level > 0; --level) {
+            wheel_cascade(base, level,
+                          (base->clk >> LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK);
+        }
+
+        uint32_t slot = base->clk & TIMER_WHEEL_MASK;
+        list_splice_after(&base->wheel[0][slot], expired->prev);
+        base->pending[0] &= ~(1ULL << slot);
+
+        base->clk++;
+    }
+}
+
+/* arms the local APIC for the earliest event, base lock held */
+static void timer_program(timer_base_t *base)
+{
+    uint64_t next = TIMER_NO_EVENT;
+
+    timer_t *head = list_peek_head_type(&base->hres, timer_t, node);
+    if (head) {
+        next = head->deadline;
+    }
+
+    uint64_t tick = wheel_next_tick(base);
+    if (tick != TIMER_NO_EVENT && tick * TIMER_TICK_NS < next) {
+        next = tick * TIMER_TICK_NS;
+    }
+
+    base->next_event = next;
+
+    /* nothing pending, let the CPU sleep until some other interrupt */
+    if (next == TIMER_NO_EVENT) {
+        lapic_timer_cancel();
+        return;
+    }
+
+    uint64_t now = clock_monotonic_ns();
+    lapic_timer_arm(next > now ? next - now : 0);
+}
+
+void timer_init(timer_t *timer)
+{
+    *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
+}
+
+void timer_set(timer_t *timer, uint64_t deadline, timer_callback_t callback,
+               void *arg)
+{
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    timer_cancel(timer);
+
+    timer_base_t *base = this_cpu_ptr(timer_base);
+    spin_lock_lock(&base->lock);
+
+    timer->deadline = deadline;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->cpu = get_current_cpu_number();
+    timer->active = true;
+
+    uint64_t now = clock_monotonic_ns();
+    if (deadline < now + TIMER_TICK_NS) {
+        hres_insert(base, timer);
+    }
+    else {
+        wheel_insert(base, timer);
+    }
+
+    /* the expiry path reprograms once it is done */
+    if (!base->in_expiry && deadline < base->next_event) {
+        timer_program(base);
+    }
+
+    spin_lock_unlock(&base->lock);
+    x86_restore_flags(flags);
+}
+
+void timer_set_oneshot(timer_t *timer, uint64_t delay,
+                       timer_callback_t callback, void *arg)
+{
+    timer_set(timer, clock_monotonic_ns() + delay, callback, arg);
+}
+
+bool timer_cancel(timer_t *timer)
+{
+    uint64_t flags;
+    bool     was_active;
+
+    timer_base_t *base = per_cpu_ptr(timer_base, timer->cpu);
+    spin_lock_lock_irqsave(&base->lock, &flags);
+
+    was_active = timer->active;
+    if (was_active) {
+        /* an expired timer waiting for its callback sits on the expiry
+         * list, wheel_remove() only clears the bit of an empty slot */
+        if (timer->hres) {
+            list_delete(&timer->node);
+        }
+        else {
+            wheel_remove(base, timer);
+        }
+        timer->active = false;
+    }
+
+    /* the APIC timer stays armed, firing for nothing just reprograms the
+     * next event */
+
+    spin_lock_unlock_irqrestore(&base->lock, flags);
+    return was_active;
+}
+
+/* runs the due timers, called with interrupts enabled */
+static void timer_expire(timer_base_t *base)
+{
+    list_t   expired = LIST_INITIAL_VALUE(expired);
+    uint64_t flags;
+
+    spin_lock_lock_irqsave(&base->lock, &flags);
+
+    uint64_t now = clock_monotonic_ns();
+
+    timer_t *timer;
+    while ((timer = list_peek_head_type(&base->hres, timer_t, node)) &&
+           timer->deadline <= now) {
+        list_delete(&timer->node);
+        list_add_tail(&expired, &timer->node);
+    }
+
+    wheel_advance(base, now / TIMER_TICK_NS, &expired);
+
+    /* timer_cancel() may still take timers off the expired list, so it is
+     * only touched with the lock held */
+    while ((timer = list_remove_head_type(&expired, timer_t, node))) {
+        timer->active = false;
+
+        spin_lock_unlock_irqrestore(&base->lock, flags);
+        timer->callback(timer, timer->arg);
+        spin_lock_lock_irqsave(&base->lock, &flags);
+    }
+
+    spin_lock_unlock_irqrestore(&base->lock, flags);
+}
+
+static void timer_softirq(void)
+{
+    timer_base_t *base = this_cpu_ptr(timer_base);
+    uint64_t      flags;
+
+    spin_lock_lock_irqsave(&base->lock, &flags);
+    base->in_expiry = true;
+    spin_lock_unlock_irqrestore(&base->lock, flags);
+
+    timer_expire(base);
+
+    spin_lock_lock_irqsave(&base->lock, &flags);
+    timer_program(base);
+    base->in_expiry = false;
+    spin_lock_unlock_irqrestore(&base->lock, flags);
+}
+
+/* hard interrupt, the timers run in the softirq */
+static void timer_interrupt(void *arg)
+{
+    softirq_raise(SOFTIRQ_TIMER);
+}
+
+static void timer_percpu_init(const void *arg)
+{
+    timer_base_t *base = this_cpu_ptr(timer_base);
+
+    spin_lock_init(&base->lock);
+    list_init(&base->hres);
+    for (uint32_t level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        for (uint32_t slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot) {
+            list_init(&base->wheel[level][slot]);
+        }
+    }
+    base->clk = clock_monotonic_ns() / TIMER_TICK_NS;
+    base->next_event = TIMER_NO_EVENT;
+
+    softirq_register(SOFTIRQ_TIMER, timer_softirq);
+    register_isr(LAPIC_TIMER_VECTOR, timer_interrupt, true);
+}
+
+REGISTER_INIT_HOOK(timer, PERCPU, 1, &timer_percpu_init, NULL);
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <list.h>
+
+typedef struct timer timer_t;
+
+/**
+ * Called once the timer expired, on the CPU the timer was set on. Callbacks
+ * run in the timer softirq with interrupts enabled, so they may take
+ * irqsave locks but must not block.
+ */
+typedef void (*timer_callback_t)(timer_t *timer, void *arg);
+
+/**
+ * One-shot timer. There is no periodic tick, every CPU programs its local
+ * APIC timer for the earliest pending event only.
+ *
+ * Timers due in a millisecond or more go to a per-CPU hierarchical timing
+ * wheel with millisecond granularity, where setting and cancelling is O(1).
+ * Shorter deadlines take the high resolution path, a small list sorted by
+ * deadline which fires on the nanosecond.
+ */
+struct timer {
+    list_node_t      node;     /* Wheel slot or high resolution list. */
+    uint64_t         deadline; /* Expiry time, see clock_monotonic_ns(). */
+    timer_callback_t callback;
+    void            *arg;
+    uint32_t         cpu;      /* CPU the timer is queued on. */
+    bool             active;   /* Queued and not expired yet. */
+    bool             hres;     /* On the high resolution list. */
+    uint8_t          level;    /* Wheel level and slot while queued. */
+    uint8_t          slot;
+};
+
+#define TIMER_INITIAL_VALUE(t)                                                 \
+    {                                                                          \
+        .node = LIST_INITIAL_CLEARED_VALUE, .deadline = 0, .callback = NULL,   \
+        .arg = NULL, .cpu = 0, .active = false, .hres = false, .level = 0,     \
+        .slot = 0,                                                             \
+    }
+
+void timer_init(timer_t *timer);
+
+/**
+ * Arms the timer on the current CPU, re-arming it if it is already active.
+ *
+ * @param timer Timer to arm.
+ *
+ * @param deadline Absolute expiry time in nanoseconds. Wheel timers fire
+ * up to a millisecond late, never early.
+ *
+ * @param callback Function called once the timer expires.
+ *
+ * @param arg Argument passed to the callback.
+ */
+void timer_set(timer_t *timer, uint64_t deadline, timer_callback_t callback,
+               void *arg);
+
+/**
+ * Same as timer_set() with a deadline relative to now.
+ *
+ * @param delay Nanoseconds from now.
+ */
+void timer_set_oneshot(timer_t *timer, uint64_t delay,
+                       timer_callback_t callback, void *arg);
+
+/**
+ * Disarms the timer. A callback already running on another CPU is not
+ * waited for.
+ *
+ * @return true if the timer was still pending.
+ */
+bool timer_cancel(timer_t *timer);
@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <tlb.h>
+#include <apic.h>
+#include <cpu_data.h>
+#include <cpumask.h>
+#include <init.h>
+#include <percpu.h>
+#include <platform.h>
+#include <x86.h>
+
+/* above this many pages reloading CR3 is cheaper than invlpg per page */
+#define TLB_FLUSH_MAX_PAGES 32
+
+/*
+ * A CPU has at most one shootdown in flight since it waits for the
+ * acknowledgements with interrupts disabled, so every CPU publishes its
+ * request in a per-CPU slot and the targets find it through a mask of the
+ * initiators that are waiting on them.
+ */
+typedef struct tlb_request {
+    const tlb_batch_t *batch;
+    uint32_t           pending; /* Targets yet to acknowledge. */
+} tlb_request_t;
+
+static DEFINE_PER_CPU(tlb_request_t, tlb_request);
+static DEFINE_PER_CPU(cpu_mask_t, tlb_initiators);
+
+static void tlb_flush_all_local(void)
+{
+    uint64_t cr4 = x86_get_cr4();
+
+    /* toggling PGE drops the global entries as well */
+    if (cr4 & X86_CR4_PGE_BIT) {
+        x86_set_cr4(cr4 & ~X86_CR4_PGE_BIT);
+        x86_set_cr4(cr4);
+    }
+    else {
+        x86_set_cr3(x86_get_cr3());
+    }
+}
+
+static void tlb_flush_local(const tlb_batch_t *batch)
+{
+    if (batch->full) {
+        tlb_flush_all_local();
+        return;
+    }
+
+    for (uint32_t i = 0; i < batch->nr_ranges; ++i) {
+        const tlb_range_t *range = &batch->ranges[i];
+
+        for (size_t page = 0; page < range->count; ++page) {
+            x86_invlpg(range->base + page * PAGE_SIZE);
+        }
+    }
+}
+
+void tlb_poll(void)
+{
+    cpu_mask_t initiators = __atomic_exchange_n(
+        this_cpu_ptr(tlb_initiators), CPU_MASK_NONE, __ATOMIC_ACQUIRE);
+    uint32_t cpu;
+
+    for_each_cpu_in_mask (cpu, initiators) {
+        tlb_request_t *req = per_cpu_ptr(tlb_request, cpu);
+
+        tlb_flush_local(req->batch);
+        __atomic_fetch_sub(&req->pending, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void tlb_shootdown_ipi(void *arg)
+{
+    tlb_poll();
+}
+
+void tlb_batch_init(tlb_batch_t *batch, vm_aspace_t *aspace)
+{
+    batch->aspace = aspace;
+    batch->nr_ranges = 0;
+    batch->full = false;
+}
+
+void tlb_batch_add(tlb_batch_t *batch, vaddr_t vaddr, size_t count)
+{
+    if (batch->full || !count) {
+        return;
+    }
+
+    size_t total = count;
+    for (uint32_t i = 0; i < batch->nr_ranges; ++i) {
+        total += batch->ranges[i].count;
+    }
+
+    if (total > TLB_FLUSH_MAX_PAGES) {
+        batch->full = true;
+        return;
+    }
+
+    /* extend the last range if the new one follows it */
+    if (batch->nr_ranges) {
+        tlb_range_t *last = &batch->ranges[batch->nr_ranges - 1];
+
+        if (last->base + last->count * PAGE_SIZE == vaddr) {
+            last->count += count;
+            return;
+        }
+    }
+
+    if (batch->nr_ranges == TLB_BATCH_MAX_RANGES) {
+        batch->full = true;
+        return;
+    }
+
+    batch->ranges[batch->nr_ranges].base = vaddr;
+    batch->ranges[batch->nr_ranges].count = count;
+    batch->nr_ranges++;
+}
+
+void tlb_batch_flush(tlb_batch_t *batch)
+{
+    if (!batch->full && !batch->nr_ranges) {
+        return;
+    }
+
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    uint32_t   self = get_current_cpu_number();
+    cpu_mask_t active =
+        __atomic_load_n(&batch->aspace->active_cpus, __ATOMIC_ACQUIRE);
+    cpu_mask_t     targets = active & ~CPU_MASK(self);
+    tlb_request_t *req = this_cpu_ptr(tlb_request);
+    uint32_t       cpu;
+
+    req->batch = batch;
+    __atomic_store_n(&req->pending, cpu_mask_weight(targets),
+                     __ATOMIC_RELEASE);
+
+    for_each_cpu_in_mask (cpu, targets) {
+        cpu_mask_t queued = __atomic_fetch_or(
+            per_cpu_ptr(tlb_initiators, cpu), CPU_MASK(self), __ATOMIC_ACQ_REL);
+
+        /* the target has not picked up the earlier requests yet, the IPI
+         * already on its way covers this one too */
+        if (!queued) {
+            lapic_send_ipi_fixed(get_cpu_data(cpu)->cpu_lapic_id,
+                                 IPI_TLB_SHOOTDOWN_VECTOR);
+        }
+    }
+
+    /* the kernel address space is live on every CPU, even before the CPU
+     * joins its mask */
+    if (cpu_mask_test(active, self) || batch->aspace == &kernel_aspace) {
+        tlb_flush_local(batch);
+    }
+
+    /* keep serving the others, one of them may be waiting on us */
+    while (__atomic_load_n(&req->pending, __ATOMIC_ACQUIRE)) {
+        tlb_poll();
+        x86_pause();
+    }
+
+    x86_restore_flags(flags);
+
+    batch->nr_ranges = 0;
+    batch->full = false;
+}
+
+void tlb_flush_range(vm_aspace_t *aspace, vaddr_t vaddr, size_t count)
+{
+    tlb_batch_t batch;
+
+    tlb_batch_init(&batch, aspace);
+    tlb_batch_add(&batch, vaddr, count);
+    tlb_batch_flush(&batch);
+}
+
+static void tlb_percpu_init(const void *arg)
+{
+    register_isr(IPI_TLB_SHOOTDOWN_VECTOR, tlb_shootdown_ipi, true);
+
+    /* every CPU runs on the kernel page tables from the moment it boots */
+    vmm_aspace_activate(&kernel_aspace);
+}
+
+REGISTER_INIT_HOOK(tlb, PERCPU, 5, &tlb_percpu_init, NULL);
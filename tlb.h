@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <types.h>
+#include <pmm.h>
+
+/* ranges a batch holds before it falls back to a full flush */
+#define TLB_BATCH_MAX_RANGES 16
+
+typedef struct tlb_range {
+    vaddr_t base;
+    size_t  count; /* Number of pages. */
+} tlb_range_t;
+
+/**
+ * Stale translations of an address space waiting to be invalidated. Page
+ * table updates queue their ranges on a batch and a single shootdown IPI per
+ * CPU then carries the whole batch.
+ */
+typedef struct tlb_batch {
+    vm_aspace_t *aspace;
+    uint32_t     nr_ranges;
+    bool         full; /* Flush the whole TLB instead of the ranges. */
+    tlb_range_t  ranges[TLB_BATCH_MAX_RANGES];
+} tlb_batch_t;
+
+/**
+ * Initializes an empty batch.
+ *
+ * @param aspace Address space whose page tables are being changed.
+ */
+void tlb_batch_init(tlb_batch_t *batch, vm_aspace_t *aspace);
+
+/**
+ * Queues a range of pages for invalidation. Adjacent ranges are merged and
+ * the batch turns into a full flush once it runs out of ranges or covers
+ * more pages than are worth invalidating one by one.
+ *
+ * @param vaddr Page aligned start of the range. A large page is invalidated
+ * by any one of its 4 KiB pages.
+ *
+ * @param count Number of 4 KiB pages.
+ */
+void tlb_batch_add(tlb_batch_t *batch, vaddr_t vaddr, size_t count);
+
+/**
+ * Invalidates the queued ranges on every CPU that has the address space
+ * active and empties the batch. The other CPUs get one IPI each, the caller
+ * flushes its own TLB while they do theirs and returns once all of them
+ * have acknowledged. Must not be called with interrupts disabled while
+ * holding a lock another CPU may spin on with interrupts disabled.
+ */
+void tlb_batch_flush(tlb_batch_t *batch);
+
+/**
+ * Invalidates a single range on every CPU that has the address space
+ * active.
+ */
+void tlb_flush_range(vm_aspace_t *aspace, vaddr_t vaddr, size_t count);
+
+/**
+ * Serves the shootdowns other CPUs are waiting on the current CPU for. Code
+ * that spins with interrupts disabled while another CPU may be flushing
+ * has to call this or the two CPUs wait on each other.
+ */
+void tlb_poll(void);
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <trace.h>
+#include <clock.h>
+#include <console/console.h>
+#include <console/kprint.h>
+#include <cpu_data.h>
+#include <percpu.h>
+#include <spinlock.h>
+#include <stdio.h>
+#include <string.h>
+#include <x86.h>
+
+bool trace_enabled;
+
+static DEFINE_PER_CPU(uint64_t, trace_head);
+static DEFINE_PER_CPU(trace_record_t[TRACE_BUF_ENTRIES], trace_buf);
+
+void __trace_record(const trace_event_t *ev, const uint64_t *args)
+{
+    /* claiming the slot with a single xadd keeps interrupt handlers that
+     * trace on the same CPU out of it */
+    uint64_t        pos = this_cpu_fetch_add(trace_head, 1);
+    trace_record_t *rec = &(*this_cpu_ptr(trace_buf))[pos % TRACE_BUF_ENTRIES];
+
+    /* the slot is invalid until the last store */
+    __atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+    rec->timestamp = x86_rdtsc();
+    rec->event = ev - __trace_events_start;
+    rec->cpu = get_current_cpu_number();
+    rec->nargs = ev->nargs;
+    for (uint32_t i = 0; i < TRACE_MAX_ARGS; ++i) {
+        rec->args[i] = args[i];
+    }
+
+    __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_enabled(bool enable)
+{
+    __atomic_store_n(&trace_enabled, enable, __ATOMIC_RELAXED);
+}
+
+bool tracepoint_set_enabled(const char *name, bool enable)
+{
+    tracepoint_t *tp;
+    bool          found = false;
+
+    for_each_tracepoint(tp) {
+        if (strcmp(tp->name, name)) {
+            continue;
+        }
+
+        if (enable) {
+            static_key_enable(&tp->key);
+        }
+        else {
+            static_key_disable(&tp->key);
+        }
+        found = true;
+    }
+
+    return found;
+}
+
+void tracepoint_list(void)
+{
+    tracepoint_t *tp;
+
+    for_each_tracepoint(tp) {
+        __kprintf(KLOG_LEVEL_INFO, "%s (%s): %s\n", tp->name, tp->func,
+                  static_key_enabled(&tp->key) ? "on" : "off");
+    }
+}
+
+/* copies out a record unless it is being written or was overwritten */
+static bool trace_read(uint32_t cpu, uint64_t pos, trace_record_t *out)
+{
+    trace_record_t *rec =
+        &(*per_cpu_ptr(trace_buf, cpu))[pos % TRACE_BUF_ENTRIES];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return false;
+    }
+
+    memcpy(out, rec, sizeof(*out));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == pos + 1;
+}
+
+static void trace_print(const trace_record_t *rec)
+{
+    const trace_event_t *ev = &__trace_events_start[rec->event];
+    char                 line[KLOG_LINE_MAX];
+
+    if (ev >= __trace_events_end) {
+        return;
+    }
+
+    snprintf(line, sizeof(line), ev->fmt, rec->args[0], rec->args[1],
+             rec->args[2], rec->args[3]);
+
+    __kprintf(KLOG_LEVEL_INFO, "[%llu] cpu%u %s: %s\n",
+              clock_tsc_to_ns(rec->timestamp), rec->cpu, ev->func, line);
+}
+
+/* merge cursors of trace_dump(), too large for a thread stack */
+static spin_lock_t trace_dump_lock;
+static uint64_t    trace_dump_pos[MAX_NCPUS];
+static uint64_t    trace_dump_end[MAX_NCPUS];
+
+bool trace_dump(void)
+{
+    uint64_t *pos = trace_dump_pos;
+    uint64_t *end = trace_dump_end;
+    uint32_t  cpu;
+
+    /* the lock is held for the whole dump, do not spin on it */
+    if (!spin_lock_trylock(&trace_dump_lock)) {
+        return false;
+    }
+
+    for_each_possible_cpu(cpu) {
+        end[cpu] = __atomic_load_n(per_cpu_ptr(trace_head, cpu),
+                                   __ATOMIC_ACQUIRE);
+        pos[cpu] = end[cpu] > TRACE_BUF_ENTRIES
+                       ? end[cpu] - TRACE_BUF_ENTRIES
+                       : 0;
+    }
+
+    /* merge the buffers, the oldest record first */
+    while (1) {
+        trace_record_t rec, oldest;
+        int32_t        from = -1;
+
+        for_each_possible_cpu(cpu) {
+            /* skip the records that are torn or already overwritten */
+            while (pos[cpu] < end[cpu] && !trace_read(cpu, pos[cpu], &rec)) {
+                pos[cpu]++;
+            }
+            if (pos[cpu] == end[cpu]) {
+                continue;
+            }
+
+            if (from < 0 || rec.timestamp < oldest.timestamp) {
+                oldest = rec;
+                from = cpu;
+            }
+        }
+
+        if (from < 0) {
+            break;
+        }
+
+        trace_print(&oldest);
+        pos[from]++;
+
+        /* the console thread cannot run while we do, push the line out
+         * before the dump overruns the kernel log */
+        console_drain();
+    }
+
+    spin_lock_unlock(&trace_dump_lock);
+    return true;
+}
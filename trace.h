@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <compiler.h>
+#include <static_key.h>
+
+#define TRACE_MAX_ARGS    4
+
+/* records kept per CPU, a power of two */
+#define TRACE_BUF_ENTRIES 256
+
+/**
+ * A trace event. Descriptors are collected in the ".trace.events" section
+ * and their format strings in ".trace.strings", the records only carry the
+ * index of the descriptor and the raw arguments. Nothing is formatted until
+ * the trace is dumped.
+ */
+typedef struct trace_event {
+    const char *fmt;  /* Format applied to the arguments when dumping. */
+    const char *func; /* Function the event is recorded in. */
+    uint32_t    nargs;
+} trace_event_t;
+
+/**
+ * A binary trace record, written by one CPU into its own buffer.
+ */
+typedef struct trace_record {
+    uint64_t seq;       /* Position in the buffer + 1, 0 while written. */
+    uint64_t timestamp; /* TSC */
+    uint16_t event;     /* Index of the event descriptor. */
+    uint8_t  cpu;
+    uint8_t  nargs;
+    uint32_t reserved;
+    uint64_t args[TRACE_MAX_ARGS];
+} trace_record_t;
+
+#define __trace_event   __section(".trace.events") __aligned(8)
+#define __trace_strings __section(".trace.strings")
+
+/* kernel.lds.S */
+extern const trace_event_t __trace_events_start[];
+extern const trace_event_t __trace_events_end[];
+
+extern bool trace_enabled;
+
+#define __TRACE_NARGS(...)                                                     \
+    __TRACE_NARGS_(_ __VA_OPT__(, ) __VA_ARGS__, 4, 3, 2, 1, 0)
+#define __TRACE_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+
+#define __TRACE_ARGS_0()
+#define __TRACE_ARGS_1(a)          (uint64_t)(a)
+#define __TRACE_ARGS_2(a, b)       (uint64_t)(a), (uint64_t)(b)
+#define __TRACE_ARGS_3(a, b, c)    (uint64_t)(a), (uint64_t)(b), (uint64_t)(c)
+#define __TRACE_ARGS_4(a, b, c, d)                                             \
+    (uint64_t)(a), (uint64_t)(b), (uint64_t)(c), (uint64_t)(d)
+#define __TRACE_ARGS__(n, ...) __TRACE_ARGS_##n(__VA_ARGS__)
+#define __TRACE_ARGS(n, ...)   __TRACE_ARGS__(n __VA_OPT__(, ) __VA_ARGS__)
+
+/* records an event unconditionally, see trace() */
+#define __trace(_fmt, ...)                                                     \
+    do {                                                                       \
+        static const char __trace_strings __trace_fmt[] = _fmt;                \
+        static const trace_event_t __trace_event __trace_ev = {                \
+            .fmt = __trace_fmt,                                                \
+            .func = __func__,                                                  \
+            .nargs = __TRACE_NARGS(__VA_ARGS__),                               \
+        };                                                                     \
+        const uint64_t __trace_args[TRACE_MAX_ARGS] = {                        \
+            __TRACE_ARGS(__TRACE_NARGS(__VA_ARGS__)                            \
+                             __VA_OPT__(, ) __VA_ARGS__)};                     \
+        __trace_record(&__trace_ev, __trace_args);                             \
+    } while (0)
+
+/**
+ * Records an event in the trace buffer of the current CPU. Safe in any
+ * context.
+ *
+ * @param _fmt printf format of the event. The arguments reach it as 64-bit
+ * values, so integers narrower than that must be printed with l or ll.
+ *
+ * @param ... Up to TRACE_MAX_ARGS integer or pointer arguments.
+ */
+#define trace(_fmt, ...)                                                       \
+    do {                                                                       \
+        if (unlikely(trace_enabled)) {                                         \
+            __trace(_fmt __VA_OPT__(, ) __VA_ARGS__);                          \
+        }                                                                      \
+    } while (0)
+
+/**
+ * A named tracepoint. Every TRACEPOINT() site places one of these in the
+ * ".tracepoints" section, so the tracepoints built into the kernel can be
+ * listed and switched on by name at runtime.
+ */
+typedef struct tracepoint {
+    const char  *name;
+    const char  *func; /* Function the tracepoint sits in. */
+    static_key_t key;
+} tracepoint_t;
+
+#define __tracepoint __section(".tracepoints") __aligned(8)
+
+/* kernel.lds.S */
+extern tracepoint_t __tracepoints_start[];
+extern tracepoint_t __tracepoints_end[];
+
+#define for_each_tracepoint(tp)                                                \
+    for ((tp) = __tracepoints_start; (tp) < __tracepoints_end; ++(tp))
+
+/**
+ * A tracepoint for the hot paths. While it is disabled the site is a single
+ * NOP and the arguments are not even evaluated, enabling it patches the
+ * site into a jump to the code recording the event. Enabled independently
+ * of trace_set_enabled().
+ *
+ * @param _name Name of the tracepoint. Sites sharing a name are switched
+ * together.
+ *
+ * @param _fmt, ... As for trace().
+ */
+#define TRACEPOINT(_name, _fmt, ...)                                           \
+    do {                                                                       \
+        static tracepoint_t __tracepoint __tp = {                              \
+            .name = stringify(_name),                                          \
+            .func = __func__,                                                  \
+            .key = STATIC_KEY_INIT,                                            \
+        };                                                                     \
+        if (static_key_unlikely(&__tp.key)) {                                  \
+            __trace(_fmt __VA_OPT__(, ) __VA_ARGS__);                          \
+        }                                                                      \
+    } while (0)
+
+void __trace_record(const trace_event_t *ev, const uint64_t *args);
+
+/**
+ * Turns recording on or off on all the CPUs.
+ */
+void trace_set_enabled(bool enable);
+
+/**
+ * Formats the records of all the CPUs in timestamp order and writes them
+ * to the consoles through the kernel log. Thread context only.
+ *
+ * @return false if another dump is in progress.
+ */
+bool trace_dump(void);
+
+/**
+ * Enables or disables every tracepoint of the given name. Must be called
+ * with interrupts enabled.
+ *
+ * @return Whether a tracepoint of that name exists.
+ */
+bool tracepoint_set_enabled(const char *name, bool enable);
+
+/**
+ * Writes the tracepoints and their state to the kernel log.
+ */
+void tracepoint_list(void);
@@ -0,0 +1,277 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <uart.h>
+#include <console/console.h>
+#include <ioapic.h>
+#include <pic.h>
+#include <platform.h>
+#include <spinlock.h>
+#include <x86.h>
+
+/* 16550 registers, offsets from the base port */
+#define UART_REG_RBR      0 /* Receive buffer (read) */
+#define UART_REG_THR      0 /* Transmit holding (write) */
+#define UART_REG_DLL      0 /* Divisor latch low (DLAB) */
+#define UART_REG_IER      1 /* Interrupt enable */
+#define UART_REG_DLM      1 /* Divisor latch high (DLAB) */
+#define UART_REG_IIR      2 /* Interrupt identification (read) */
+#define UART_REG_FCR      2 /* FIFO control (write) */
+#define UART_REG_LCR      3 /* Line control */
+#define UART_REG_MCR      4 /* Modem control */
+#define UART_REG_LSR      5 /* Line status */
+#define UART_REG_MSR      6 /* Modem status */
+#define UART_REG_SCR      7 /* Scratch */
+
+#define UART_IER_THRE     0x02 /* Transmit holding register empty */
+
+#define UART_IIR_NO_INT   0x01
+#define UART_IIR_ID_MASK  0x0e
+#define UART_IIR_MSR      0x00
+#define UART_IIR_THRE     0x02
+#define UART_IIR_RX       0x04
+#define UART_IIR_LSR      0x06
+#define UART_IIR_TIMEOUT  0x0c
+#define UART_IIR_FIFO     0xc0 /* FIFOs enabled and working (16550A) */
+
+#define UART_FCR_ENABLE   0x01
+#define UART_FCR_CLEAR_RX 0x02
+#define UART_FCR_CLEAR_TX 0x04
+#define UART_FCR_TRIG_14  0xc0
+
+#define UART_LCR_8N1      0x03
+#define UART_LCR_DLAB     0x80
+
+#define UART_MCR_DTR      0x01
+#define UART_MCR_RTS      0x02
+#define UART_MCR_OUT2     0x08 /* Gates the IRQ line on PCs */
+
+#define UART_LSR_DR       0x01 /* Data ready */
+#define UART_LSR_THRE     0x20 /* Transmit holding register empty */
+
+#define UART_CLOCK_BAUD   115200
+#define UART_BAUD         115200
+
+#define UART_FIFO_SIZE    16
+#define UART_TX_BUF_SIZE  4096
+
+typedef struct uart {
+    uint16_t    base;
+    uint32_t    fifo_size;
+    bool        irq_enabled;
+    spin_lock_t lock;
+
+    /* polled output, bytes that still fit the FIFO since it was empty */
+    uint32_t poll_room;
+
+    /* interrupt driven output, running counts into tx_buf */
+    bool     tx_busy; /* A transmitter-empty interrupt is on its way. */
+    uint32_t tx_head;
+    uint32_t tx_tail;
+    uint8_t  tx_buf[UART_TX_BUF_SIZE];
+} uart_t;
+
+static uart_t com1 = {.base = UART_COM1_BASE};
+
+static inline uint8_t uart_read(uart_t *u, uint16_t reg)
+{
+    return x86_inp8(u->base + reg);
+}
+
+static inline void uart_write(uart_t *u, uint16_t reg, uint8_t val)
+{
+    x86_outp8(u->base + reg, val);
+}
+
+static void uart_wait_thre(uart_t *u)
+{
+    while (!(uart_read(u, UART_REG_LSR) & UART_LSR_THRE)) {
+        x86_pause();
+    }
+}
+
+/* the FIFO is empty once THRE is set, so a full FIFO's worth goes out
+ * after every wait rather than a single byte */
+static void uart_poll_putc(uart_t *u, uint8_t c)
+{
+    if (!u->poll_room) {
+        uart_wait_thre(u);
+        u->poll_room = u->fifo_size;
+    }
+
+    uart_write(u, UART_REG_THR, c);
+    u->poll_room--;
+}
+
+/* moves a burst from the software buffer into the empty FIFO */
+static void uart_fill_fifo(uart_t *u)
+{
+    uint32_t count = 0;
+
+    while (count < u->fifo_size && u->tx_tail != u->tx_head) {
+        uart_write(u, UART_REG_THR,
+                   u->tx_buf[u->tx_tail++ % UART_TX_BUF_SIZE]);
+        count++;
+    }
+
+    u->tx_busy = count != 0;
+    u->poll_room = 0;
+}
+
+static void uart_queue_putc(uart_t *u, uint8_t c)
+{
+    /* the buffer is full, push a burst out by hand */
+    if (u->tx_head - u->tx_tail == UART_TX_BUF_SIZE) {
+        uart_wait_thre(u);
+        uart_fill_fifo(u);
+    }
+
+    u->tx_buf[u->tx_head++ % UART_TX_BUF_SIZE] = c;
+}
+
+static void uart_console_write(console_t *con, const uint8_t *text,
+                               size_t len)
+{
+    uart_t  *u = &com1;
+    uint64_t flags = x86_save_flags();
+    x86_cli();
+
+    /* with interrupts already off this is the panic path, the holder of the
+     * lock may never release it */
+    bool emergency = !(flags & X86_FLAGS_IF);
+    bool locked = spin_lock_trylock(&u->lock);
+
+    if (!locked && !emergency) {
+        spin_lock_lock(&u->lock);
+        locked = true;
+    }
+
+    if (!u->irq_enabled || emergency) {
+        /* keep the output in order, the buffered bytes go first */
+        while (u->tx_tail != u->tx_head) {
+            uart_poll_putc(u, u->tx_buf[u->tx_tail++ % UART_TX_BUF_SIZE]);
+        }
+
+        for (size_t i = 0; i < len; ++i) {
+            if (text[i] == '\n') {
+                uart_poll_putc(u, '\r');
+            }
+            uart_poll_putc(u, text[i]);
+        }
+    }
+    else {
+        for (size_t i = 0; i < len; ++i) {
+            if (text[i] == '\n') {
+                uart_queue_putc(u, '\r');
+            }
+            uart_queue_putc(u, text[i]);
+        }
+
+        /* the transmitter is idle, no interrupt is going to pick the
+         * buffer up */
+        if (!u->tx_busy) {
+            uart_wait_thre(u);
+            uart_fill_fifo(u);
+        }
+    }
+
+    if (locked) {
+        spin_lock_unlock(&u->lock);
+    }
+    x86_restore_flags(flags);
+}
+
+static void uart_isr(void *arg)
+{
+    uart_t *u = arg;
+    uint8_t iir;
+
+    spin_lock_lock(&u->lock);
+
+    while (!((iir = uart_read(u, UART_REG_IIR)) & UART_IIR_NO_INT)) {
+        switch (iir & UART_IIR_ID_MASK) {
+        case UART_IIR_THRE:
+            uart_fill_fifo(u);
+            break;
+
+        case UART_IIR_RX:
+        case UART_IIR_TIMEOUT:
+            /* there is no input side, drop what was received */
+            while (uart_read(u, UART_REG_LSR) & UART_LSR_DR) {
+                uart_read(u, UART_REG_RBR);
+            }
+            break;
+
+        case UART_IIR_LSR:
+            uart_read(u, UART_REG_LSR);
+            break;
+
+        default:
+            uart_read(u, UART_REG_MSR);
+            break;
+        }
+    }
+
+    spin_lock_unlock(&u->lock);
+}
+
+static console_t uart_console = {
+    .name = "ttyS0",
+    .write = uart_console_write,
+};
+
+bool uart_init(void)
+{
+    uart_t  *u = &com1;
+    uint16_t divisor = UART_CLOCK_BAUD / UART_BAUD;
+
+    /* a missing UART reads back all ones */
+    uart_write(u, UART_REG_SCR, 0x5a);
+    if (uart_read(u, UART_REG_SCR) != 0x5a) {
+        return false;
+    }
+
+    spin_lock_init(&u->lock);
+
+    uart_write(u, UART_REG_IER, 0);
+
+    uart_write(u, UART_REG_LCR, UART_LCR_DLAB);
+    uart_write(u, UART_REG_DLL, divisor & 0xff);
+    uart_write(u, UART_REG_DLM, divisor >> 8);
+    uart_write(u, UART_REG_LCR, UART_LCR_8N1);
+
+    uart_write(u, UART_REG_FCR, UART_FCR_ENABLE | UART_FCR_CLEAR_RX |
+                                    UART_FCR_CLEAR_TX | UART_FCR_TRIG_14);
+    uart_write(u, UART_REG_MCR, UART_MCR_DTR | UART_MCR_RTS | UART_MCR_OUT2);
+
+    /* an 8250 or a 16550 with a broken FIFO takes one byte at a time */
+    bool fifo = (uart_read(u, UART_REG_IIR) & UART_IIR_FIFO) == UART_IIR_FIFO;
+    u->fifo_size = fifo ? UART_FIFO_SIZE : 1;
+
+    register_console(&uart_console);
+    return true;
+}
+
+void uart_enable_irq(void)
+{
+    uart_t  *u = &com1;
+    bool     level, active_low;
+    uint32_t gsi = ioapic_isa_to_gsi(UART_COM1_IRQ, &level, &active_low);
+    uint8_t  vector = PIC1_VECTOR_OFFSET + UART_COM1_IRQ;
+    uint64_t flags;
+
+    if (!u->fifo_size) {
+        return;
+    }
+
+    register_isr(vector, uart_isr, !level);
+    if (!ioapic_map_gsi(gsi, vector, level, active_low)) {
+        return;
+    }
+
+    spin_lock_lock_irqsave(&u->lock, &flags);
+
+    u->irq_enabled = true;
+    uart_write(u, UART_REG_IER, UART_IER_THRE);
+
+    spin_lock_unlock_irqrestore(&u->lock, flags);
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UART_COM1_BASE 0x3f8
+#define UART_COM1_IRQ  4
+
+/**
+ * Sets up COM1 as a 16550 at 115200 8N1 with the FIFOs enabled and
+ * registers it as a console. Output is polled until uart_enable_irq().
+ * Called early, before the interrupt controllers are set up.
+ *
+ * @return false if there is no UART.
+ */
+bool uart_init(void);
+
+/**
+ * Switches the console to interrupt driven output. Writes go to a software
+ * buffer and the transmitter-empty interrupt refills the FIFO a burst at a
+ * time. Needs ioapic_init().
+ */
+void uart_enable_irq(void);
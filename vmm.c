@@ -1,4 +1,5 @@
 #include <pmm.h>
+#include <cpu_data.h>
 
 static list_node_t aspace_list = LIST_INITIAL_VALUE(aspace_list);
 
@@ -13,3 +14,15 @@ void vmm_init_preheap(void)
     /* add the kernel address space to address space list */
     list_add(&aspace_list, &kernel_aspace.node);
 }
+
+void vmm_aspace_activate(vm_aspace_t *aspace)
+{
+    __atomic_fetch_or(&aspace->active_cpus, CPU_MASK(get_current_cpu_number()),
+                      __ATOMIC_ACQ_REL);
+}
+
+void vmm_aspace_deactivate(vm_aspace_t *aspace)
+{
+    __atomic_fetch_and(&aspace->active_cpus,
+                       ~CPU_MASK(get_current_cpu_number()), __ATOMIC_ACQ_REL);
+}
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: MIT */
+
+#include <workqueue.h>
+#include <clock.h>
+#include <cpu_data.h>
+#include <init.h>
+#include <percpu.h>
+#include <pmm.h>
+#include <scheduler.h>
+#include <spinlock.h>
+#include <string.h>
+#include <thread.h>
+#include <timer.h>
+
+/* workers a pool holds at most, blocked ones included */
+#define WORKER_POOL_MAX      16
+
+/* an idle worker beyond the spare one exits after this long */
+#define WORKER_IDLE_TIMEOUT  (5 * NSEC_PER_SEC)
+
+#define WORKER_PRIORITY      DEFAULT_PRIORITY
+#define WORKER_HIGHPRI       (HIGHEST_PRIORITY - 1)
+
+typedef struct worker_pool worker_pool_t;
+
+typedef struct worker {
+    list_node_t    node;       /* Idle list of the pool. */
+    thread_t      *thread;
+    worker_pool_t *pool;
+    uint64_t       idle_since;
+    bool           used;       /* Slot taken. */
+    bool           idle;       /* Waiting for work. */
+    bool           sleeping;   /* Blocked inside a work item. */
+    bool           exit;       /* Asked to exit by the idle timer. */
+} worker_t;
+
+struct worker_pool {
+    spin_lock_t lock;
+    uint32_t    cpu;
+    int         priority;
+    list_t      worklist;
+    list_t      idle_list;  /* Most recently idle first. */
+    uint32_t    nr_workers;
+    uint32_t    nr_idle;
+    uint32_t    nr_running; /* Workers neither idle nor blocked. */
+    bool        creating;   /* A worker is being created. */
+    timer_t     idle_timer;
+
+    worker_t workers[WORKER_POOL_MAX];
+};
+
+/* normal and high priority pool of each CPU */
+DEFINE_PER_CPU(worker_pool_t[2], worker_pools);
+
+static workqueue_t system_workqueue = {
+    .name = "events",
+    .flags = 0,
+};
+
+workqueue_t *system_wq = &system_workqueue;
+
+static void worker_thread(void *arg);
+
+static inline worker_t *thread_to_worker(thread_t *t)
+{
+    return t->arg;
+}
+
+/* pool lock held */
+static void pool_wake_idle(worker_pool_t *pool)
+{
+    worker_t *w = list_remove_head_type(&pool->idle_list, worker_t, node);
+    if (!w) {
+        return;
+    }
+
+    w->idle = false;
+    pool->nr_idle--;
+    pool->nr_running++;
+    thread_unblock(w->thread);
+}
+
+/*
+ * Adds a worker to the pool. The new worker counts as running until it
+ * finds the worklist empty. Called without the pool lock.
+ */
+static bool pool_create_worker(worker_pool_t *pool)
+{
+    uint64_t flags;
+    worker_t *w = NULL;
+
+    spin_lock_lock_irqsave(&pool->lock, &flags);
+
+    if (pool->creating || pool->nr_workers == WORKER_POOL_MAX) {
+        spin_lock_unlock_irqrestore(&pool->lock, flags);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < WORKER_POOL_MAX; ++i) {
+        if (!pool->workers[i].used) {
+            w = &pool->workers[i];
+            break;
+        }
+    }
+
+    memset(w, 0, sizeof(*w));
+    w->used = true;
+    w->pool = pool;
+    pool->creating = true;
+
+    spin_lock_unlock_irqrestore(&pool->lock, flags);
+
+    thread_t *t = thread_create_on(pool->cpu, (uint8_t *)"kworker",
+                                   worker_thread, w, pool->priority, NULL, 0,
+                                   THREAD_FLAG_WORKER);
+
+    spin_lock_lock_irqsave(&pool->lock, &flags);
+
+    pool->creating = false;
+    if (t) {
+        w->thread = t;
+        pool->nr_workers++;
+        pool->nr_running++;
+    }
+    else {
+        w->used = false;
+    }
+
+    spin_lock_unlock_irqrestore(&pool->lock, flags);
+
+    if (t) {
+        thread_detach(t);
+        thread_unblock(t);
+    }
+    return t != NULL;
+}
+
+/* retires the longest idle worker if it is not the only one */
+static void pool_idle_timer(timer_t *timer, void *arg)
+{
+    worker_pool_t *pool = arg;
+    uint64_t       flags;
+
+    spin_lock_lock_irqsave(&pool->lock, &flags);
+
+    worker_t *w = list_peek_tail_type(&pool->idle_list, worker_t, node);
+    if (pool->nr_idle > 1 && w) {
+        if (clock_monotonic_ns() - w->idle_since >= WORKER_IDLE_TIMEOUT) {
+            list_delete(&w->node);
+            w->idle = false;
+            w->exit = true;
+            pool->nr_idle--;
+            thread_unblock(w->thread);
+        }
+
+        if (pool->nr_idle > 1) {
+            timer_set_oneshot(&pool->idle_timer, WORKER_IDLE_TIMEOUT,
+                              pool_idle_timer, pool);
+        }
+    }
+
+    spin_lock_unlock_irqrestore(&pool->lock, flags);
+}
+
+static void worker_thread(void *arg)
+{
+    worker_t      *w = arg;
+    worker_pool_t *pool = w->pool;
+    thread_t      *cur = get_current_thread();
+    uint64_t       flags;
+
+    spin_lock_lock_irqsave(&pool->lock, &flags);
+
+    for (;;) {
+        if (w->exit) {
+            pool->nr_workers--;
+            w->used = false;
+            spin_lock_unlock_irqrestore(&pool->lock, flags);
+            thread_exit(0);
+        }
+
+        work_t *work = list_remove_head_type(&pool->worklist, work_t, node);
+        if (!work) {
+            w->idle = true;
+            w->idle_since = clock_monotonic_ns();
+            list_add(&pool->idle_list, &w->node);
+            pool->nr_idle++;
+            pool->nr_running--;
+
+            /* one idle worker is kept around as the spare */
+            if (pool->nr_idle == 2) {
+                timer_set_oneshot(&pool->idle_timer, WORKER_IDLE_TIMEOUT,
+                                  pool_idle_timer, pool);
+            }
+
+            /* interrupts stay off until we are switched out, a wakeup
+             * in between just puts us back on the run queue */
+            cur->state = THREAD_STATE_WAITING;
+            spin_lock_unlock(&pool->lock);
+            thread_reschedule();
+            spin_lock_lock(&pool->lock);
+            continue;
+        }
+
+        /* the work item may be queued again while it runs */
+        __atomic_store_n(&work->pending, 0, __ATOMIC_RELEASE);
+
+        /* keep a spare worker for when this one blocks */
+        bool need_spare = !pool->nr_idle;
+        spin_lock_unlock_irqrestore(&pool->lock, flags);
+
+        if (need_spare) {
+            pool_create_worker(pool);
+        }
+
+        work->func(work);
+
+        spin_lock_lock_irqsave(&pool->lock, &flags);
+    }
+}
+
+void workqueue_worker_sleeping(thread_t *t)
+{
+    worker_t *w = thread_to_worker(t);
+
+    if (w->idle || w->sleeping) {
+        return;
+    }
+    w->sleeping = true;
+
+    worker_pool_t *pool = w->pool;
+    spin_lock_lock(&pool->lock);
+
+    /* keep the CPU busy with the next work item */
+    if (--pool->nr_running == 0 && !list_is_empty(&pool->worklist)) {
+        pool_wake_idle(pool);
+    }
+
+    spin_lock_unlock(&pool->lock);
+}
+
+void workqueue_worker_running(thread_t *t)
+{
+    worker_t *w = thread_to_worker(t);
+
+    if (!w->sleeping) {
+        return;
+    }
+    w->sleeping = false;
+
+    worker_pool_t *pool = w->pool;
+    spin_lock_lock(&pool->lock);
+    pool->nr_running++;
+    spin_lock_unlock(&pool->lock);
+}
+
+void work_init(work_t *work, work_func_t func)
+{
+    *work = (work_t)WORK_INITIAL_VALUE(func);
+}
+
+workqueue_t *workqueue_create(const char *name, uint32_t flags)
+{
+    workqueue_t *wq = pmm_alloc_kpages(1, NULL);
+    if (!wq) {
+        return NULL;
+    }
+
+    memset(wq, 0, sizeof(*wq));
+
+    size_t len = strlen(name);
+    if (len > sizeof(wq->name) - 1) {
+        len = sizeof(wq->name) - 1;
+    }
+    memcpy(wq->name, name, len);
+    wq->flags = flags;
+
+    return wq;
+}
+
+void workqueue_destroy(workqueue_t *wq)
+{
+    if (wq != system_wq) {
+        pmm_free_kpages(wq, 1);
+    }
+}
+
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work)
+{
+    if (__atomic_exchange_n(&work->pending, 1, __ATOMIC_ACQ_REL)) {
+        return false;
+    }
+
+    worker_pool_t *pool =
+        &per_cpu(worker_pools, cpu)[(wq->flags & WQ_HIGHPRI) ? 1 : 0];
+    uint64_t flags;
+
+    spin_lock_lock_irqsave(&pool->lock, &flags);
+
+    list_add_tail(&pool->worklist, &work->node);
+
+    /* a running worker picks it up once it is done */
+    if (!pool->nr_running) {
+        pool_wake_idle(pool);
+    }
+
+    spin_lock_unlock_irqrestore(&pool->lock, flags);
+    return true;
+}
+
+bool queue_work(workqueue_t *wq, work_t *work)
+{
+    return queue_work_on(get_current_cpu_number(), wq, work);
+}
+
+static void workqueue_percpu_init(const void *arg)
+{
+    worker_pool_t *pools = *this_cpu_ptr(worker_pools);
+
+    for (uint32_t i = 0; i < 2; ++i) {
+        worker_pool_t *pool = &pools[i];
+
+        spin_lock_init(&pool->lock);
+        pool->cpu = get_current_cpu_number();
+        pool->priority = i ? WORKER_HIGHPRI : WORKER_PRIORITY;
+        list_init(&pool->worklist);
+        list_init(&pool->idle_list);
+        timer_init(&pool->idle_timer);
+
+        /* the first worker is the spare */
+        pool_create_worker(pool);
+    }
+}
+
+REGISTER_INIT_HOOK(workqueue, PERCPU, 4, &workqueue_percpu_init, NULL);
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: MIT */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <list.h>
+
+typedef struct work      work_t;
+typedef struct workqueue workqueue_t;
+
+typedef void (*work_func_t)(work_t *work);
+
+/**
+ * A function run asynchronously on a kernel thread. Embed it in the
+ * structure the function works on and get back to it with container_of().
+ */
+struct work {
+    list_node_t node;
+    work_func_t func;
+    uint32_t    pending; /* Queued and not started yet. */
+};
+
+#define WORK_INITIAL_VALUE(_func)                                              \
+    {                                                                          \
+        .node = LIST_INITIAL_CLEARED_VALUE, .func = (_func), .pending = 0,     \
+    }
+
+/* Workqueue flags */
+#define WQ_HIGHPRI (1 << 0) /* Served by the high priority worker pools. */
+
+/**
+ * A named front end to the worker pools. Every CPU has a normal and a high
+ * priority pool of worker threads shared by all the workqueues. A pool runs
+ * one worker at a time and wakes another one only when the running worker
+ * blocks, so work items are executed on the CPU they were queued on without
+ * piling up threads.
+ */
+struct workqueue {
+    char     name[32];
+    uint32_t flags;
+};
+
+/**
+ * Default workqueue for short work items.
+ */
+extern workqueue_t *system_wq;
+
+void work_init(work_t *work, work_func_t func);
+
+/**
+ * Creates a workqueue.
+ *
+ * @param name Name of the workqueue.
+ *
+ * @param flags WQ_* flags.
+ *
+ * @return Pointer to the workqueue or NULL on failure.
+ */
+workqueue_t *workqueue_create(const char *name, uint32_t flags);
+
+/**
+ * Destroys a workqueue. Work items still queued on it run regardless.
+ */
+void workqueue_destroy(workqueue_t *wq);
+
+/**
+ * Queues the work item on the current CPU.
+ *
+ * @return false if the work item was already pending.
+ */
+bool queue_work(workqueue_t *wq, work_t *work);
+
+/**
+ * Queues the work item on the specified CPU.
+ *
+ * @param cpu CPU number.
+ *
+ * @return false if the work item was already pending.
+ */
+bool queue_work_on(uint32_t cpu, workqueue_t *wq, work_t *work);
+
+/*
+ * Scheduler hooks, called with interrupts disabled when a worker thread
+ * blocks in the middle of a work item and once it runs again.
+ */
+struct thread;
+void workqueue_worker_sleeping(struct thread *t);
+void workqueue_worker_running(struct thread *t);
@@ -3,18 +3,51 @@
 #pragma once
 
 /* Control Register 0 */
-#define X86_CR0_WP_BIT        0x00010000 /* Write Protect */
-#define X86_CR0_PG_BIT        0x80000000 /* Paging enabled */
+#define X86_CR0_PE_BIT              0x00000001 /* Protection Enable */
+#define X86_CR0_WP_BIT              0x00010000 /* Write Protect */
+#define X86_CR0_PG_BIT              0x80000000 /* Paging enabled */
 
 /* Control Register 4 */
-#define X86_CR4_PAE_BIT       0x00000020 /* Physical Address Extensions */
-#define X86_CR4_SMEP_BIT      0x00200000 /* Supervisor Mode Execution Protection */
-#define X86_CR4_SMAP_BIT      0x00400000 /* Supervisor Mode Access Prevention */
+#define X86_CR4_PAE_BIT             0x00000020 /* Physical Address Extensions */
+#define X86_CR4_PGE_BIT             0x00000080 /* Page Global Enable */
+#define X86_CR4_SMEP_BIT            0x00200000 /* Supervisor Mode Execution Protection */
+#define X86_CR4_SMAP_BIT            0x00400000 /* Supervisor Mode Access Prevention */
+
+/* RFLAGS */
+#define X86_FLAGS_IF                0x00000200 /* Interrupt Enable */
+
+/* MSR APIC Base */
+#define X86_IA32_MSR_APIC_BASE      0x0000001b
+#define X86_IA32_MSR_APIC_BASE_BSP  0x00000100 /* Bootstrap Processor */
+#define X86_IA32_MSR_APIC_BASE_EXTD 0x00000400 /* x2APIC Mode Enable */
+#define X86_IA32_MSR_APIC_BASE_EN   0x00000800 /* APIC Global Enable */
+
+/* MSR TSC Deadline */
+#define X86_IA32_MSR_TSC_DEADLINE   0x000006e0
+
+/* First x2APIC register MSR */
+#define X86_IA32_MSR_X2APIC_BASE    0x00000800
+
+/* CPUID leaf 1 feature bits */
+#define X86_CPUID_1_ECX_X2APIC      0x00200000 /* x2APIC */
+#define X86_CPUID_1_ECX_TSC_DL      0x01000000 /* TSC-deadline timer */
+
+/* CPUID leaf 7 (subleaf 0) feature bits */
+#define X86_CPUID_7_EBX_ERMS        0x00000200 /* Enhanced rep movsb/stosb */
+#define X86_CPUID_7_EDX_FSRM        0x00000010 /* Fast short rep movsb */
+
+/* CPUID leaf 0x80000007 power management bits */
+#define X86_CPUID_80000007_EDX_INVTSC 0x00000100 /* Invariant TSC */
 
 /* MSR EFER */
-#define X86_IA32_MSR_EFER     0xc0000080
-#define X86_IA32_MSR_EFER_LME 0x00000100 /* Long Mode Enable */
-#define X86_IA32_MSR_EFER_NXE 0x00001000 /* No-Execute Enable */
+#define X86_IA32_MSR_EFER           0xc0000080
+#define X86_IA32_MSR_EFER_LME       0x00000100 /* Long Mode Enable */
+#define X86_IA32_MSR_EFER_NXE       0x00001000 /* No-Execute Enable */
+
+/* Segment base MSRs */
+#define X86_IA32_MSR_FS_BASE        0xc0000100
+#define X86_IA32_MSR_GS_BASE        0xc0000101
+#define X86_IA32_MSR_KERNEL_GS_BASE 0xc0000102
 
 #ifndef __ASSEMBLY__
 
@@ -52,6 +85,27 @@ static inline void x86_cli(void)
     __asm__ volatile("cli");
 }
 
+/**
+ * Enables interrupts and halts. The instruction following sti still runs
+ * with interrupts disabled, so no wakeup can slip in before the hlt.
+ */
+static inline void x86_safe_halt(void)
+{
+    __asm__ volatile("sti\n"
+                     "hlt\n");
+}
+
+static inline void x86_pause(void)
+{
+    __asm__ volatile("pause");
+}
+
+static inline void x86_invlpg(uint64_t addr)
+{
+    __asm__ volatile("invlpg (%0)" ::"r"(addr)
+                     : "memory");
+}
+
 /*
  * I/O Ports
  */
@@ -126,10 +180,37 @@ static inline void x86_cpuid_c(uint32_t leaf, uint32_t csel,
                      : "a"(leaf), "c"(csel));
 }
 
+/**
+ * Initial APIC ID of the calling processor, the full 32-bit x2APIC ID when
+ * the extended topology leaf is available.
+ */
+static inline uint32_t x86_initial_apic_id(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+
+    x86_cpuid(0x0, &eax, &ebx, &ecx, &edx);
+    if (eax >= 0xb) {
+        x86_cpuid_c(0xb, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx) {
+            return edx;
+        }
+    }
+
+    x86_cpuid(0x1, &eax, &ebx, &ecx, &edx);
+    return ebx >> 24;
+}
+
 /*
  * x86-specific registers
  */
 
+static inline uint64_t x86_rdtsc(void)
+{
+    uint32_t hi, lo;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 static inline uint64_t x86_read_msr(uint32_t msr_id)
 {
     uint64_t rv;